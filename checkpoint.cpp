@@ -0,0 +1,95 @@
+// checkpoint.cpp
+// © 2009 by Andreas Maunz, andreas@maunz.de, sep 2009
+
+/*
+    This file is part of LibFminer (libfminer).
+
+    LibFminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LibFminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LibFminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+namespace fm {
+    extern unsigned int gsw_counter;
+}
+
+Checkpoint::Checkpoint (string _filename, unsigned int _interval) : filename(_filename), interval(_interval), last_write(0), resumed(false), counter(0), offset(-1) {
+    FILE* f = fopen ( filename.c_str (), "r" );
+    if (f) {
+        char kind[8], end[2];
+        unsigned int root, legs, cnt;
+        long pos;
+        // the trailing '.' guards against a record cut off by the interruption
+        while ( fscanf ( f, "%7s %u %u %u %ld %1s", kind, &root, &legs, &cnt, &pos, end ) == 6 && end[0] == '.' ) {
+            resumed = true;
+            counter = cnt;
+            offset = pos;
+            if ( !strcmp ( kind, "root" ) ) roots_done.insert ( root );
+            else if ( !strcmp ( kind, "leg" ) ) legs_done[root] = legs;
+        }
+        fclose ( f );
+    }
+}
+
+bool Checkpoint::Seekable () {
+    struct stat st;
+    cout.flush ();
+    return !fstat ( fileno ( stdout ), &st ) && S_ISREG ( st.st_mode ) && ftell ( stdout ) >= 0;
+}
+
+unsigned int Checkpoint::LegsDone ( unsigned int root ) {
+    map<unsigned int, unsigned int>::iterator it = legs_done.find ( root );
+    if ( it == legs_done.end () ) return 0;
+    return it->second;
+}
+
+void Checkpoint::Legs ( unsigned int root, unsigned int legs ) {
+    if ( time ( NULL ) - last_write < (time_t) interval ) return;
+    legs_done[root] = legs;
+    Write ( "leg", root, legs );
+}
+
+// discard output written after the last record and continue graph ids from there
+void Checkpoint::Restore () {
+    fm::gsw_counter = counter;
+    cout.flush ();
+    struct stat st;
+    if ( offset < 0 || !Seekable () || fstat ( fileno ( stdout ), &st ) ) {
+        cerr << "Warning! Output is not a regular file, output after the last checkpoint is not discarded." << endl;
+        return;
+    }
+    if ( st.st_size < offset ) {
+        cerr << "Warning! Output is shorter than recorded in checkpoint '" << filename << "' (append to the output of the interrupted run)." << endl;
+        return;
+    }
+    if ( ftruncate ( fileno ( stdout ), offset ) || fseek ( stdout, offset, SEEK_SET ) ) {
+        cerr << "Error! Could not truncate output to checkpoint position " << offset << "." << endl;
+        exit(1);
+    }
+    cerr << "Notice: Resuming from checkpoint '" << filename << "' (" << roots_done.size () << " roots done)." << endl;
+}
+
+void Checkpoint::Write ( const char* kind, unsigned int root, unsigned int legs ) {
+    cout.flush ();
+    long pos = ftell ( stdout );
+    FILE* f = fopen ( filename.c_str (), "a" );
+    if (!f) { cerr << "Error! Could not write checkpoint file '" << filename << "'." << endl; exit(1); }
+    fprintf ( f, "%s %u %u %u %ld .\n", kind, root, legs, fm::gsw_counter, pos );
+    fclose ( f );
+    last_write = time ( NULL );
+}
@@ -0,0 +1,58 @@
+// checkpoint.h
+// © 2009 by Andreas Maunz, andreas@maunz.de, sep 2009
+
+/*
+    This file is part of LibFminer (libfminer).
+
+    LibFminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LibFminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LibFminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <set>
+#include <map>
+
+#include "misc.h"
+
+// Records completed subtrees of a mining run in a plain text file, one record per line:
+//   <kind> <root> <legs> <graph counter> <output offset> .
+// kind is 'start' (header written), 'leg' (the first <legs> root legs of <root> are done)
+// or 'root' (<root> is done). A restarted run with the same input and settings
+// truncates the output to the last recorded offset and skips what is done.
+class Checkpoint {
+  public:
+    Checkpoint (string _filename, unsigned int _interval);
+    static bool Seekable (); // output positions can only be recorded and restored in a regular file
+    bool Resumed () { return resumed; }
+    void Restore ();
+    bool RootDone ( unsigned int root ) { return roots_done.find ( root ) != roots_done.end (); }
+    unsigned int LegsDone ( unsigned int root );
+    void Start () { Write ( "start", 0, 0 ); }
+    void Root ( unsigned int root ) { roots_done.insert ( root ); Write ( "root", root, 0 ); }
+    void Legs ( unsigned int root, unsigned int legs );
+  private:
+    void Write ( const char* kind, unsigned int root, unsigned int legs );
+    string filename;
+    unsigned int interval; // minimum number of seconds between two 'leg' records
+    time_t last_write;
+    bool resumed;
+    set<unsigned int> roots_done;
+    map<unsigned int, unsigned int> legs_done;
+    unsigned int counter; // graph id counter and output position of the last record
+    long offset;
+};
+
+#endif
@@ -20,34 +20,54 @@
  */
 
 #include <vector>
+#include <algorithm>
 #include "misc.h"
 #include "closeleg.h"
+#include "database.h"
 
 namespace fm {
     extern unsigned int minfreq;
     extern CloseLegOccurrences* closelegoccurrences;
     extern LegOccurrences* legoccurrences;
     extern vector<vector< CloseLegOccurrences> > candidatecloselegsoccs;
-    extern vector<bool> candidatecloselegsoccsused;
-    extern bool closelegsoccsused;
+    extern vector<pair<int, EdgeLabel> > candidatecloselegstouched;
+    extern Database* database;
+}
+
+CloseLegOccurrences &candidateCloseLegs ( int number, EdgeLabel edgelabel ) {
+  if ( (int) fm::candidatecloselegsoccs.size () <= number )
+    fm::candidatecloselegsoccs.resize ( number + 1 );
+  vector<CloseLegOccurrences> &edgelabeloccs = fm::candidatecloselegsoccs[number];
+  if ( edgelabeloccs.size () < fm::database->frequentEdgeLabelSize () )
+    edgelabeloccs.resize ( fm::database->frequentEdgeLabelSize () );
+  CloseLegOccurrences &occs = edgelabeloccs[edgelabel];
+  if ( occs.elements.empty () )
+    fm::candidatecloselegstouched.push_back ( make_pair ( number, edgelabel ) );
+  return occs;
+}
+
+void candidateCloseLegsReset () {
+  for ( int k = 0; k < (int) fm::candidatecloselegstouched.size (); k++ ) {
+    CloseLegOccurrences &occs = fm::candidatecloselegsoccs[fm::candidatecloselegstouched[k].first][fm::candidatecloselegstouched[k].second];
+    occs.elements.resize ( 0 );
+    occs.frequency = 0;
+  }
+  fm::candidatecloselegstouched.resize ( 0 );
 }
 
 void addCloseExtensions ( vector<CloseLegPtr> &targetcloselegs, int number ) {
-  if ( fm::closelegsoccsused ) {
-    for ( int i = 1; i < (int) fm::candidatecloselegsoccs.size (); i++ )
-      if ( fm::candidatecloselegsoccsused[i] ) {
-        vector<CloseLegOccurrences> &edgelabeloccs = fm::candidatecloselegsoccs[i];
-        for ( EdgeLabel j = 0; j < edgelabeloccs.size (); j++ ) {
-          if ( edgelabeloccs[j].frequency >= fm::minfreq ) {
-            CloseLegPtr closelegptr = new CloseLeg;
-            closelegptr->tuple.label = j;
-            closelegptr->tuple.to = i;
-            closelegptr->tuple.from = number;
-            swap ( closelegptr->occurrences, edgelabeloccs[j] );
-            targetcloselegs.push_back ( closelegptr );
-          }
-        }
-      }
+  vector<pair<int, EdgeLabel> > &touched = fm::candidatecloselegstouched;
+  sort ( touched.begin (), touched.end () ); // order of node number, then edge label
+  for ( int k = 0; k < (int) touched.size (); k++ ) {
+    CloseLegOccurrences &occs = fm::candidatecloselegsoccs[touched[k].first][touched[k].second];
+    if ( occs.frequency >= fm::minfreq ) {
+      CloseLegPtr closelegptr = new CloseLeg;
+      closelegptr->tuple.label = touched[k].second;
+      closelegptr->tuple.to = touched[k].first;
+      closelegptr->tuple.from = number;
+      swap ( closelegptr->occurrences, occs );
+      targetcloselegs.push_back ( closelegptr );
+    }
   }
 }
 
@@ -63,7 +63,10 @@ struct CloseLeg {
 
 typedef CloseLeg *CloseLegPtr;
 
-extern bool closelegsoccsused;
+// close leg candidates of the last extend, by node number and edge label. Only the entries
+// filled by extend are listed (and reset by the next extend) in candidatecloselegstouched.
+CloseLegOccurrences &candidateCloseLegs ( int number, EdgeLabel edgelabel );
+void candidateCloseLegsReset ();
 
 class Leg;
 typedef Leg *LegPtr;
@@ -22,18 +22,110 @@
 
 float ChisqConstraint::ChiSq(float x, float y, bool decide_activating) {
 
+        float ea = 0.0, impact = 0.0, val = 0.0;
+        
+        if (decide_activating) {
+            impact = x/(float)n;
+            ea = na * impact; 
+            if (y>ea) activating=1; else activating=0;
+        }
+
+        // table is only valid as long as the class sizes do not change
+        unsigned int ya = (unsigned int) y, yi = (unsigned int) (x-y);
+        if (table.size() && table_na == na && table_ni == ni && ya <= na && yi <= ni) val = table[ya * (ni+1) + yi];
+        else val = ChiSqValue(x, y);
+
+        if (val >= 0.0) chisq = val;
+
+        return(chisq);
+
+}
+
+float ChisqConstraint::ChiSqValue(float x, float y) {
+
         float ea = 0.0, ei = 0.0, impact = 0.0;
         
         impact = x/(float)n;
         ea = na * impact; 
         ei = ni * impact; 
 
-        if (decide_activating) {
-            if (y>ea) activating=1; else activating=0;
-        }
+        if (ea>0 && ei>0) return (y-ea-0.5)*(y-ea-0.5)/ea + (x-y-ei-0.5)*(x-y-ei-0.5)/ei;
+        return -1.0;
 
-        if (ea>0 && ei>0) chisq = (y-ea-0.5)*(y-ea-0.5)/ea + (x-y-ei-0.5)*(x-y-ei-0.5)/ei;
+}
 
-        return(chisq);
+// For fixed m, z^2 is convex in the activity sum. The values of a more specific feature are a subset of the
+// current values, so for each size m its sum lies between the sums of the m smallest and the m largest values.
+void ChisqConstraint::RegressionBounds() {
+    unsigned int k = values.size();
+    p = Z2(k, sum);
+    activating = ( sum > k * mean );
+    sort(values.begin(), values.end());
+    double low = 0.0, high = 0.0;
+    u = 0.0;
+    for (unsigned int m = 1; m <= k; m++) {
+        low += values[m-1];
+        high += values[k-m];
+        float u1 = Z2(m, low), u2 = Z2(m, high);
+        if (u1 > u) u = u1;
+        if (u2 > u) u = u2;
+    }
+    // sampling: z^2 grows linearly with the number of compounds
+    p *= wa; u *= wa;
+}
+
+void ChisqConstraint::Moments() {
+    double s = 0.0, ss = 0.0;
+    unsigned int all = n; // including compounds not in the sample
+    n = 0;
+    each (fm::database->trees) {
+        DatabaseTree& tree = *fm::database->trees[i];
+        if (tree.activity[target] == -1) continue;
+        s += tree.value[target]; n++;
+    }
+    mean = ( n ? s / n : 0.0 );
+    na = 0; ni = 0;
+    each (fm::database->trees) {
+        DatabaseTree& tree = *fm::database->trees[i];
+        if (tree.activity[target] == -1) continue;
+        double d = tree.value[target] - mean;
+        ss += d * d;
+        if (tree.value[target] > mean) na++; else ni++;
+    }
+    var = ( n ? ss / n : 0.0 );
+    wa = wi = ( n ? all / (float) n : 1.0 );
+}
+
+void ChisqConstraint::Weights() {
+    unsigned int sa = 0, si = 0;
+    each (fm::database->trees) {
+        if (fm::database->trees[i]->activity[target] == 1) sa++;
+        else if (fm::database->trees[i]->activity[target] == 0) si++;
+    }
+    // the sample is drawn before activities are known and weighted per class afterwards (post-stratification)
+    if (na && !sa) cerr << "Warning! No active compound of target " << target << " in the sample, increase the sample rate." << endl;
+    if (ni && !si) cerr << "Warning! No inactive compound of target " << target << " in the sample, increase the sample rate." << endl;
+    wa = ( sa ? na / (float) sa : 1.0 );
+    wi = ( si ? ni / (float) si : 1.0 );
+}
+
+void ChisqConstraint::Tabulate(unsigned int max_size) {
+    table.clear();
+    table_na = na; table_ni = ni;
+    if (!n || (double) (na+1) * (ni+1) > max_size) return;
+    table.resize((na+1) * (ni+1));
+    for (unsigned int ya = 0; ya <= na; ya++)
+        for (unsigned int yi = 0; yi <= ni; yi++)
+            table[ya * (ni+1) + yi] = ChiSqValue(ya + yi, ya);
+}
+
+float SignificanceMeasure::Threshold(int measure, float confidence) {
+    if (measure == FISHER) return -log(1.0 - confidence);
+    return gsl_cdf_chisq_Pinv(confidence, 1);
+}
 
+double SignificanceMeasure::LogFactorial(unsigned int k) {
+    static vector<double> table(1, 0.0);
+    while (table.size() <= k) table.push_back(table.back() + log((double) table.size()));
+    return table[k];
 }
@@ -23,6 +23,8 @@
 #define CONSTRAINTS_H
 
 #include <set>
+#include <algorithm>
+#include <math.h>
 #include <gsl/gsl_cdf.h>
 #include <gsl/gsl_randist.h>
 #include <gsl/gsl_statistics.h>
@@ -32,10 +34,22 @@
 namespace fm {
     extern Database* database;
     extern bool line_nrs;
+    extern bool edge_occurrences;
+    extern bool regression;
 }
 
 class Constraint {};
 
+//!< Significance measures of ChisqConstraint (member 'measure'). Each measure is a struct with static inline
+//!< Score (c, x, y, decide_activating) for a feature occurring in x compounds, y of them active (larger is more
+//!< significant, compared to c.sig), and Bound (c, x, y), an upper bound of Score for all more specific
+//!< features (x' <= x, y' <= y, x'-y' <= x-y) used for pruning. ChisqConstraint::Bounds<M>() inlines both.
+struct SignificanceMeasure {
+    enum Type { CHISQ = 0, FISHER = 1, INFOGAIN = 2, ODDSRATIO = 3 };
+    static float Threshold (int measure, float confidence); //!< Threshold of the measure for a significance level
+    static double LogFactorial (unsigned int k); //!< ln k!, from a table grown on demand
+};
+
 class ChisqConstraint : public Constraint {
     public:
     unsigned int na, ni, n;
@@ -44,8 +58,21 @@ class ChisqConstraint : public Constraint {
     bool active;
     set<Tid> fa_set, fi_set;
     bool activating; //defaults to deactivating (0)
+    unsigned int target; // activity endpoint (index into the activities of a compound)
+    bool pruned; // multi-target mining: upper bound failed above the current pattern
+    int measure; // SignificanceMeasure::Type
+    float confidence; // significance level, sig is the threshold of the measure for it
+    // regression: na (ni) counts the compounds with activity above (not above) the mean
+    double mean, var; // of the activities of all compounds with a value for the target
+    double sum; // of the activities of the current feature
+    vector<float> values; // activities of the current feature
+    // sampling: na, ni and n count all compounds, fa and fi are scaled by the compounds per sampled compound of their class
+    float wa, wi;
+
+    ChisqConstraint (float sig, unsigned int target = 0) : na(0), ni(0), n(0), fa(0), fi(0), sig(sig), chisq(0.0), p(0.0), u(0.0), active(0), activating(0), target(target), pruned(0), measure(SignificanceMeasure::CHISQ), confidence(0.95), mean(0.0), var(0.0), sum(0.0), wa(1.0), wi(1.0), table_na(0), table_ni(0) {}
 
-    ChisqConstraint (float sig) : na(0), ni(0), n(0), fa(0), fi(0), sig(sig), chisq(0.0), p(0.0), u(0.0), active(0), activating(0) {}
+    //!< Precompute chi^2 for all (fa, fi) of the current class sizes if there are at most max_size pairs (0 disables the table)
+    void Tabulate(unsigned int max_size);
 
     //!< Calculate chi^2 of current and upper bound for chi^2 of more specific features (see Morishita and Sese, 2000)
     template <typename OccurrenceType>
@@ -57,22 +84,94 @@ class ChisqConstraint : public Constraint {
         fa = fa_set.size(); // fa is y(I) in Morishita and Sese
         fi = fi_set.size(); // fi is x(I)-y(I)  in Morishita and Sese
 
-        // chisq_p for current feature
-        p = ChiSq(fa+fi,fa,1);
-
-        // upper bound u for chisq_p of more specific features
-        float u1 = 0.0, u2 = 0.0;
-        u1 = ChiSq(fa,fa,0);                                  // upper bound at
-        u2 = ChiSq(fi,0,0);                                   // max{ chisq (y(I), y(I)) ,
-        u = u1; if (u2>u1) u = u2;                            //      chisq (x(I)-y(I),0) }
+        Bounds();
     
     }
 
+    //!< Calc for all endpoints that are not pruned, in one pass over the occurrences (grouped by tid)
+    template <typename OccurrenceType>
+    static void Calc(vector<ChisqConstraint*>& endpoints, vector<OccurrenceType>& legocc) {
+
+        if (endpoints.size() == 1 && !fm::regression) { endpoints[0]->Calc(legocc); return; }
+
+        each (endpoints) {
+            ChisqConstraint& c = *endpoints[i];
+            c.chisq = 0.0; c.p = 0.0; c.u = 0.0; c.fa = 0; c.fi = 0;
+            c.fa_set.clear(); c.fi_set.clear();
+            c.values.clear(); c.sum = 0.0;
+        }
+
+        // a single endpoint always records the compounds (see GraphState::print)
+        bool sets = ( fm::edge_occurrences || endpoints.size() == 1 );
+        Tid last = NOTID;
+        for (unsigned int k = 0; k < legocc.size(); k++) {
+            if (legocc[k].tid == last) continue;
+            last = legocc[k].tid;
+            DatabaseTree& tree = *fm::database->trees[last];
+            Tid id = ( fm::line_nrs ? tree.line_nr : tree.orig_tid );
+            each (endpoints) {
+                ChisqConstraint& c = *endpoints[i];
+                if (c.pruned || tree.activity[c.target] == -1) continue;
+                if (fm::regression) {
+                    float v = tree.value[c.target];
+                    c.values.push_back(v); c.sum += v;
+                    if (v > c.mean) { c.fa++; if (sets) c.fa_set.insert(id); }
+                    else { c.fi++; if (sets) c.fi_set.insert(id); }
+                }
+                else if (tree.activity[c.target] == 1) { c.fa++; if (fm::edge_occurrences) c.fa_set.insert(id); }
+                else if (tree.activity[c.target] == 0) { c.fi++; if (fm::edge_occurrences) c.fi_set.insert(id); }
+            }
+        }
+
+        each (endpoints) {
+            if (endpoints[i]->pruned) continue;
+            if (fm::regression) endpoints[i]->RegressionBounds();
+            else endpoints[i]->Bounds();
+        }
+
+    }
+
+    //!< Regression: count the compounds above (na) and not above (ni) the mean activity, and its variance
+    void Moments();
+
+    //!< Sampling: set the weights of the classes from the compounds in the database (the sample), warn if a class is not in the sample
+    void Weights();
+
     private:
 
+    friend struct ChisqMeasure;
+
+    //!< Calculates the measure of the current feature and the upper bound from fa and fi
+    void Bounds();
+
+    //!< Regression: calculates z^2 of the current feature and its upper bound from the values
+    void RegressionBounds();
+
+    //!< Squared z-value of the difference in mean activity between m compounds with activity sum s and the others
+    float Z2(unsigned int m, double s) {
+        if (m == 0 || m >= n || var <= 0.0) return 0.0;
+        double d = s - m * mean;
+        return d * d * n / ( var * m * (n - m) );
+    }
+
+    // sampling: each weighted class count is rounded once, so that the counts of a more specific
+    // feature stay within the vertices of this one for the measures on integer counts (Fisher)
+    template <class Measure>
+    void Bounds() {
+        float ya = (unsigned int) ( fa * wa + 0.5 ), yi = (unsigned int) ( fi * wi + 0.5 );
+        p = Measure::Score(*this, ya+yi, ya, 1);
+        u = Measure::Bound(*this, ya+yi, ya);
+    }
+
     //!< Calculates chi^2 and upper bound values
     float ChiSq(float x, float y, bool decide_activating);
 
+    //!< chi^2 of x occurrences, y of them active, or -1 if undefined (no expected occurrences)
+    float ChiSqValue(float x, float y);
+
+    vector<float> table; // chi^2 at index fa * (ni+1) + fi, empty if not tabulated
+    unsigned int table_na, table_ni; // class sizes the table was built for
+
     //!< Counts occurrences of legs in active and inactive compounds
     template <typename OccurrenceType>
     void LegActivityOccurrence(vector<OccurrenceType>& legocc) {
@@ -82,12 +181,12 @@ class ChisqConstraint : public Constraint {
 
       each (legocc) { 
 
-        if (fm::database->trees[legocc[i].tid]->activity == 1) {
+        if (fm::database->trees[legocc[i].tid]->activity[target] == 1) {
             if (fm::line_nrs) fa_set.insert(fm::database->trees[legocc[i].tid]->line_nr); 
             else fa_set.insert(fm::database->trees[legocc[i].tid]->orig_tid); 
         }
 
-        else if (fm::database->trees[legocc[i].tid]->activity == 0) {
+        else if (fm::database->trees[legocc[i].tid]->activity[target] == 0) {
             if (fm::line_nrs) fi_set.insert(fm::database->trees[legocc[i].tid]->line_nr); 
             else fi_set.insert(fm::database->trees[legocc[i].tid]->orig_tid); 
         }
@@ -100,5 +199,95 @@ class ChisqConstraint : public Constraint {
 
 };
 
+//!< Upper bound at max{ score (y(I), y(I)), score (x(I)-y(I), 0) }, for measures that are convex in (x, y)
+//!< (see Morishita and Sese, 2000) or increasing in y and decreasing in x-y on either side of independence
+template <class Measure>
+inline float VertexBound (ChisqConstraint& c, float x, float y) {
+    float u1 = Measure::Score(c, y, y, 0);
+    float u2 = Measure::Score(c, x-y, 0, 0);
+    return (u2>u1 ? u2 : u1);
+}
+
+// activating if more active compounds than expected
+inline bool Activating (ChisqConstraint& c, float x, float y) {
+    return ( y > c.na * (x / (float) c.n) );
+}
+
+//!< Chi-square with continuity correction
+struct ChisqMeasure {
+    static inline float Score (ChisqConstraint& c, float x, float y, bool decide_activating) { return c.ChiSq(x, y, decide_activating); }
+    static inline float Bound (ChisqConstraint& c, float x, float y) { return VertexBound<ChisqMeasure>(c, x, y); }
+};
+
+//!< -ln p of the one-sided Fisher exact test in the direction of the deviation. The hypergeometric tail is
+//!< summed from the observed count by the ratio of consecutive terms until they vanish, the bound is one term.
+struct FisherMeasure {
+    static inline double LogChoose (unsigned int a, unsigned int b) {
+        return SignificanceMeasure::LogFactorial(a) - SignificanceMeasure::LogFactorial(b) - SignificanceMeasure::LogFactorial(a-b);
+    }
+    static inline float Score (ChisqConstraint& c, float x, float y, bool decide_activating) {
+        bool up = Activating(c, x, y);
+        if (decide_activating) c.activating = up;
+        unsigned int X = (unsigned int) x, Y = (unsigned int) y;
+        double h = 1.0, sum = 1.0; // terms relative to the one at Y
+        if (up) {
+            unsigned int hi = ( X < c.na ? X : c.na );
+            for (unsigned int k = Y; k < hi && h > sum * 1e-12; k++) {
+                h *= (double) (c.na-k) * (X-k) / ( (double) (k+1) * (c.ni-X+k+1) );
+                sum += h;
+            }
+        }
+        else {
+            unsigned int lo = ( X > c.ni ? X - c.ni : 0 );
+            for (unsigned int k = Y; k > lo && h > sum * 1e-12; k--) {
+                h *= (double) k * (c.ni-X+k) / ( (double) (c.na-k+1) * (X-k+1) );
+                sum += h;
+            }
+        }
+        double score = LogChoose(c.n, X) - LogChoose(c.na, Y) - LogChoose(c.ni, X-Y) - log(sum);
+        return ( score > 0.0 ? score : 0.0 );
+    }
+    static inline float Bound (ChisqConstraint& c, float x, float y) { return VertexBound<FisherMeasure>(c, x, y); }
+};
+
+//!< Information gain as G-statistic (2 n IG in nats), chi-square distributed like ChisqMeasure
+struct InfoGainMeasure {
+    static inline double Cell (double o, double e) { return ( o > 0.0 ? o * log (o / e) : 0.0 ); }
+    static inline float Score (ChisqConstraint& c, float x, float y, bool decide_activating) {
+        if (decide_activating) c.activating = Activating(c, x, y);
+        double n = c.n;
+        double g = Cell(y, x * c.na / n) + Cell(x-y, x * c.ni / n) + Cell(c.na-y, (n-x) * c.na / n) + Cell(c.ni-(x-y), (n-x) * c.ni / n);
+        return 2.0 * g;
+    }
+    static inline float Bound (ChisqConstraint& c, float x, float y) { return VertexBound<InfoGainMeasure>(c, x, y); }
+};
+
+//!< Woolf test of the log odds ratio (squared z-value), Haldane-Anscombe corrected by 0.5 per cell
+struct OddsRatioMeasure {
+    static inline float Score (ChisqConstraint& c, float x, float y, bool decide_activating) {
+        if (decide_activating) c.activating = Activating(c, x, y);
+        double a = y + 0.5, b = x - y + 0.5, ca = c.na - y + 0.5, ci = c.ni - (x-y) + 0.5;
+        double l = log ( (a * ci) / (b * ca) );
+        return l * l / ( 1.0/a + 1.0/b + 1.0/ca + 1.0/ci );
+    }
+    // the log odds ratio increases with y and decreases with x-y, so its magnitude is largest at (y, y) or
+    // (x-y, 0); each variance term is smallest at one of the corners
+    static inline float Bound (ChisqConstraint& c, float x, float y) {
+        double l1 = log ( ( (y + 0.5) * (c.ni + 0.5) ) / ( 0.5 * (c.na - y + 0.5) ) );
+        double l2 = log ( ( 0.5 * (c.ni - (x-y) + 0.5) ) / ( (x - y + 0.5) * (c.na + 0.5) ) );
+        double l = ( fabs(l1) > fabs(l2) ? fabs(l1) : fabs(l2) );
+        return l * l / ( 1.0/(y + 0.5) + 1.0/(x - y + 0.5) + 1.0/(c.na + 0.5) + 1.0/(c.ni + 0.5) );
+    }
+};
+
+inline void ChisqConstraint::Bounds() {
+    switch (measure) {
+        case SignificanceMeasure::FISHER: Bounds<FisherMeasure>(); break;
+        case SignificanceMeasure::INFOGAIN: Bounds<InfoGainMeasure>(); break;
+        case SignificanceMeasure::ODDSRATIO: Bounds<OddsRatioMeasure>(); break;
+        default: Bounds<ChisqMeasure>();
+    }
+}
+
 
 #endif
@@ -27,8 +27,21 @@
 namespace fm {
     extern bool aromatic;
     extern unsigned int minfreq;
+    extern float sample_rate;
+    extern unsigned int sample_seed;
 }
 
+// hash of id and seed, uniform in [0, 2^32)
+bool Database::sampled ( Tid orig_tid ) {
+  if ( fm::sample_rate >= 1.0 ) return true;
+  unsigned int h = ( orig_tid * 2654435761u ) ^ fm::sample_seed;
+  h ^= h >> 16; h *= 0x45d9f3bu; h ^= h >> 16; h *= 0x45d9f3bu; h ^= h >> 16;
+  return h < fm::sample_rate * 4294967296.0;
+}
+
+// consumes the node and edge lines of a tree that is not in the sample
+static void skipTreeGsp ( FILE *input );
+
 ostream &operator<< ( ostream &stream, DatabaseTreeEdge &databasetreeedge ) {
   stream << "DatabaseTreeEdge; edgelabel: " << databasetreeedge.edgelabel << "; tonode: " << databasetreeedge.tonode << endl;
   return stream;
@@ -119,6 +132,7 @@ bool Database::readTreeSmi (string smi, Tid tid, Tid orig_tid, int line_nr) {
         // Store direction internal label -> node
         // if node has NOT been present, label it and set frequency to 1
         if ( p.second ) {
+          checkLabelCount ( nodelabels, NONODELABEL, "node" );
           vector_push_back ( DatabaseNodeLabel, nodelabels, nodelabel );
           nodelabel.inputlabel = inputnodelabel;
           nodelabel.occurrences.parent = NULL;
@@ -206,6 +220,7 @@ bool Database::readTreeSmi (string smi, Tid tid, Tid orig_tid, int line_nr) {
      
             // Direction internal label -> edge
             if ( p.second ) {
+              checkLabelCount ( edgelabels, NOEDGELABEL, "edge" );
               vector_push_back ( DatabaseEdgeLabel, edgelabels, edgelabel );
               edgelabel.fromnodelabel = node1label;	// directed edges
               edgelabel.tonodelabel = node2label;
@@ -288,10 +303,10 @@ void Database::readGsp (FILE* input) {
   string tree_s = array; Tid orig_tid = (unsigned int) atoi((tree_s.substr(tree_s.find_first_of("123456789"))).c_str());
 
   while ( !feof ( input ) ) {
-    readTreeGsp ( input, tid2, orig_tid );
+    if ( sampled ( orig_tid ) ) { readTreeGsp ( input, tid2, orig_tid ); tid2++; }
+    else { skipTreeGsp ( input ); skipped++; }
     fgets ( array, 100, input );
     tree_s = array; orig_tid = (unsigned int) atoi((tree_s.substr(tree_s.find_first_of("123456789"))).c_str());
-    tid2++;
   }
 
 }
@@ -325,6 +340,15 @@ char readcommand ( FILE *input ) {
   return car;
 }
 
+static void skipTreeGsp ( FILE *input ) {
+  char command = readcommand ( input );
+  while ( command == 'v' || command == 'e' ) {
+    readint ( input ); readint ( input );
+    if ( command == 'e' ) readint ( input );
+    command = readcommand ( input );
+  }
+}
+
 void Database::readTreeGsp ( FILE *input, Tid tid , Tid orig_tid) {
   InputNodeLabel inputnodelabel;
 
@@ -352,6 +376,7 @@ void Database::readTreeGsp ( FILE *input, Tid tid , Tid orig_tid) {
 
     map_insert_pair ( nodelabelmap ) p = nodelabelmap.insert ( make_pair ( inputnodelabel, nodelabels.size () ) );
     if ( p.second ) {
+      checkLabelCount ( nodelabels, NONODELABEL, "node" );
       vector_push_back ( DatabaseNodeLabel, nodelabels, nodelabel );
       nodelabel.inputlabel = inputnodelabel;
       nodelabel.occurrences.parent = NULL;
@@ -399,6 +424,7 @@ void Database::readTreeGsp ( FILE *input, Tid tid , Tid orig_tid) {
 
     map_insert_pair ( edgelabelmap ) p = edgelabelmap.insert ( make_pair ( combinedinputlabel, edgelabels.size () ) );
     if ( p.second ) {
+      checkLabelCount ( edgelabels, NOEDGELABEL, "edge" );
       vector_push_back ( DatabaseEdgeLabel, edgelabels, edgelabel );
       edgelabel.fromnodelabel = node1label;
       edgelabel.tonodelabel = node2label;
@@ -607,6 +633,51 @@ void Database::reorder () {
     }
 
 
+    // PHASE III: MOVE FREQUENT EDGES TO ONE ARENA
+    // extend and join visit the edges of many trees in tid order, which is now a forward scan
+
+    size_t edgessize = 0;
+    for ( Tid i = 0; i < trees.size (); i++ )
+        for ( NodeId j = 0; j < trees[i]->nodes.size (); j++ )
+            edgessize += trees[i]->nodes[j].edges.size ();
+    edgearena.resize ( edgessize );
+    size_t pos = 0;
+    for ( Tid i = 0; i < trees.size (); i++ ) {
+        DatabaseTree &tree = * (trees[i]);
+        for ( NodeId j = 0; j < tree.nodes.size (); j++ ) {
+            pvector<DatabaseTreeEdge> &edges = tree.nodes[j].edges;
+            for ( int l = 0; l < edges.size (); l++ ) edgearena[pos + l] = edges[l];
+            edges.array = edges.size () ? &edgearena[pos] : NULL;
+            pos += edges.size ();
+        }
+        delete [] tree.edges;                                                           // per tree storage of the input
+        tree.edges = NULL;
+    }
+
+}
+
+// Occurrence lists are sorted by tid, so extend and join visit the trees in tid order. Trees are
+// sorted by their sorted node labels (the label histogram), ties in input order, such that similar
+// compounds, which tend to share occurrences, are neighbours in the occurrence lists and the edge arena.
+// orig_tid and line_nr are kept, the output does not depend on tids.
+void Database::localize () {
+    vector<pair<vector<NodeLabel>, Tid> > keys ( trees.size () );
+    for ( Tid i = 0; i < trees.size (); i++ ) {
+        DatabaseTree &tree = * (trees[i]);
+        keys[i].first.reserve ( tree.nodes.size () );
+        for ( NodeId j = 0; j < tree.nodes.size (); j++ )
+            keys[i].first.push_back ( tree.nodes[j].nodelabel );
+        sort ( keys[i].first.begin (), keys[i].first.end () );
+        keys[i].second = i;
+    }
+    sort ( keys.begin (), keys.end () );
+
+    vector<DatabaseTreePtr> localized ( trees.size () );
+    for ( Tid i = 0; i < trees.size (); i++ ) {
+        localized[i] = trees[keys[i].second];
+        localized[i]->tid = i;
+    }
+    trees.swap ( localized );
 }
 
 void Database::printTrees () {
@@ -615,6 +686,8 @@ void Database::printTrees () {
 }
 
 Database::~Database () {
-  for (unsigned int i = 0; i < trees.size (); i++ )
+  for (unsigned int i = 0; i < trees.size (); i++ ) {
+    delete [] trees[i]->edges;
     delete trees[i];
+  }
 }
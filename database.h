@@ -40,14 +40,20 @@ using namespace OpenBabel;
 typedef short InputEdgeLabel;
 typedef short InputNodeLabel;
 typedef short InputNodeId;
-typedef unsigned int CombinedInputLabel;
+typedef unsigned long long CombinedInputLabel;
 
-#define combineInputLabels(label1,label2,label3) (label1 | ( ((unsigned int) label2 ) << 16 ) | ( ( (unsigned int) label3 ) << 24 ) )
-// maximum 255 node labels for now.
+// 16 bits for each label, enough for both label widths
+#define combineInputLabels(label1,label2,label3) ( ( (CombinedInputLabel) (unsigned short) label1 ) | ( ( (CombinedInputLabel) label2 ) << 16 ) | ( ( (CombinedInputLabel) label3 ) << 32 ) )
 
 #define NOINPUTEDGELABEL ((InputEdgeLabel) -1)
 #define NOINPUTNODELABEL ((InputNodeLabel) -1)
 
+// the largest value of a label type is reserved (NONODELABEL, NOEDGELABEL)
+#define checkLabelCount(_labels,_max,_kind) do { if ( ( _labels ).size () >= (unsigned int) ( _max ) ) { \
+    cerr << "Error! More than " << (unsigned int) ( _max ) << " " << _kind << " labels, rebuild with WIDE_LABELS (see Makefile)." << endl; \
+    exit(1); \
+  } } while ( 0 )
+
 template<class T>
 class pvector {
 public:
@@ -83,6 +89,7 @@ struct DatabaseTreeNode {
 /*
 Nodes:			nodes =  [node1, ..., node n]
 Edges			edges -> [e1 of n1,...,em of n1, ..., e1 of nn...,ek of nn]
+After reorder, the edges of all trees are in one arena of the database (tree 1, ..., tree m).
 */
 
 struct DatabaseTree {
@@ -91,10 +98,11 @@ struct DatabaseTree {
   vector<DatabaseTreeNode> nodes;
 
   DatabaseTreeEdge *edges;
-  int activity;
+  vector<int> activity; // per target, -1 if unknown
+  vector<float> value; // per target, activity in regression mode
 
-  DatabaseTree ( Tid tid , Tid orig_tid , int line_nr ): tid ( tid ), orig_tid (orig_tid ), line_nr (line_nr), activity ( -1 ) { }
-  DatabaseTree () { }
+  DatabaseTree ( Tid tid , Tid orig_tid , int line_nr ): tid ( tid ), orig_tid (orig_tid ), line_nr (line_nr), edges ( NULL ), activity ( 1, -1 ) { }
+  DatabaseTree () : edges ( NULL ) { }
   
   friend ostream &operator<< ( ostream &stream, DatabaseTree &databasetree );
 };
@@ -124,13 +132,14 @@ struct DatabaseEdgeLabel {
 
 class Database {
   public:
-    Database() {}
+    Database() : skipped ( 0 ) {}
     vector<DatabaseTreePtr> trees;
     map<Tid, DatabaseTreePtr> trees_map;
     vector<DatabaseNodeLabel> nodelabels;
     vector<DatabaseEdgeLabel> edgelabels;
     map<InputNodeLabel,NodeLabel> nodelabelmap;
     map<CombinedInputLabel,EdgeLabel> edgelabelmap;
+    vector<DatabaseTreeEdge> edgearena; // frequent edges of all trees, contiguous in tid and node order (filled by reorder)
     vector<EdgeLabel> edgelabelsindexes; // given an edge label, returns the index of the element in edgelabels in which
     EdgeLabel frequentEdgeLabelSize () const { return edgelabelsindexes.size (); }
                                          // all information about this edge can be found. Used during the search,
@@ -147,13 +156,21 @@ class Database {
      // - cleans up the datastructures used until now for counting frequencies
      // - changes the edge label order to optimise the search, fills the database with order numbers instead of
      //   the numbers assigned in the previous levels; fills edgelabelsindexes.
+     // - moves the remaining edges of all trees to edgearena
     void reorder ();
 
+     // before "reorder", renumbers the trees such that trees with similar node labels have neighbouring tids
+    void localize ();
+
     void printTrees ();
     ~Database ();
     bool readTreeSmi (string smi, Tid tid , Tid orig_tid, int line_nr);
     void readGsp (FILE* input);
     void readTreeGsp (FILE *input, Tid orig_tid, Tid tid);
+
+     // sampling mode (Fminer::SetSample): whether a compound is in the sample, decided by its id and the seed
+    static bool sampled ( Tid orig_tid );
+    unsigned int skipped; // compounds read but not in the sample
   
   	// Perform DFS through tree to identify cycles
     void determineCycledNodes ( DatabaseTreePtr tree, vector<int> &nodestack, vector<bool> &visited1, vector<bool> &visited2 );
@@ -78,14 +78,22 @@ Fminer::~Fminer() {
     if (fm::instance_present) {
         delete fm::database;
         delete fm::statistics; 
+        for (unsigned int t = 1; t < fm::endpoints.size(); t++) delete fm::endpoints[t];
+        fm::endpoints.clear();
         delete fm::chisq; 
         delete fm::graphstate;
         delete fm::closelegoccurrences;
         delete fm::legoccurrences;
+        delete fm::checkpoint;
+        delete fm::incremental;
+        fm::incremental = NULL;
 
         fm::candidatelegsoccurrences.clear();
+        fm::candidatelegstouched.clear();
+        fm::embeddingnumber.clear();
+        fm::embeddingstamp.clear();
         fm::candidatecloselegsoccs.clear();
-        fm::candidatecloselegsoccsused.clear();
+        fm::candidatecloselegstouched.clear();
 
         fm::instance_present=false;
     }
@@ -95,25 +103,40 @@ void Fminer::Reset() {
     if (fm::instance_present) {
         delete fm::database;
         delete fm::statistics;
+        for (unsigned int t = 1; t < fm::endpoints.size(); t++) delete fm::endpoints[t];
         delete fm::chisq;
         delete fm::graphstate;
         delete fm::closelegoccurrences;
         delete fm::legoccurrences;
+        delete fm::checkpoint;
+        if (fm::incremental) { delete fm::incremental; fm::incremental = new Incremental(); }
     }
+    fm::checkpoint = NULL;
     fm::database = new Database();
     fm::statistics = new Statistics();
     fm::chisq = new ChisqConstraint(3.84146);
+    fm::endpoints.clear();
+    fm::endpoints.push_back(fm::chisq);
     fm::graphstate = new GraphState();
     fm::closelegoccurrences = new CloseLegOccurrences();
     fm::legoccurrences = new LegOccurrences();
 
-    fm::candidatecloselegsoccsused.clear();
+    fm::candidatelegsoccurrences.clear();
+    fm::candidatelegstouched.clear();
+    fm::candidatecloselegsoccs.clear();
+    fm::candidatecloselegstouched.clear();
+    fm::shard_plan.clear();
 
     SetChisqActive(true); 
     fm::result = &r;
     comp_runner=0; 
     comp_no=0; 
+    init_database_done = false;
     init_mining_done = false;
+    output_open = false;
+    fm::cancelled = false;
+    fm::deadline = 0;
+    if (fm::sample_minfreq) { fm::minfreq = fm::sample_minfreq; fm::sample_minfreq = 0; }
 }
 
 void Fminer::Defaults() {
@@ -126,6 +149,7 @@ void Fminer::Defaults() {
     fm::do_output=true;
     fm::bbrc_sep=false;
     fm::most_specific_trees_only=false;
+    fm::closed_only=false;
     fm::line_nrs=false;
     // LAST
     fm::do_last=true;
@@ -134,12 +158,28 @@ void Fminer::Defaults() {
     fm::updated = true;
     fm::gsp_out=true;
     fm::die = 0;
+    fm::max_time = 0;
+    fm::embedding_min_size = 8;
+    fm::chisq_table_size = 1<<20;
+    fm::tid_locality = false;
+    fm::edge_occurrences = false;
+    fm::regression = false;
+    fm::sample_rate = 1.0;
+    fm::sample_seed = 0;
+    fm::sample_minfreq = 0;
+    fm::checkpoint_file = "";
+    fm::checkpoint_interval = 60;
+    fm::shard = 0;
+    fm::shards = 1;
+    fm::shard_legs = false;
+    fm::shard_balance = false;
+    fm::shard_plan.clear();
 }
 
 
 // 2. Getter methods
 
-int Fminer::GetMinfreq(){return fm::minfreq;}
+int Fminer::GetMinfreq(){return ( fm::sample_minfreq ? fm::sample_minfreq : fm::minfreq );}
 int Fminer::GetType(){return fm::type;}
 bool Fminer::GetBackbone(){return false;}
 bool Fminer::GetDynamicUpperBound(){return false;}
@@ -150,10 +190,26 @@ bool Fminer::GetRefineSingles() {return fm::refine_singles;}
 bool Fminer::GetDoOutput() {return fm::do_output;}
 bool Fminer::GetBbrcSep(){return fm::bbrc_sep;}
 bool Fminer::GetMostSpecTreesOnly(){return fm::most_specific_trees_only;}
+bool Fminer::GetClosedOnly(){return fm::closed_only;}
 bool Fminer::GetChisqActive(){return fm::chisq->active;}
 float Fminer::GetChisqSig(){return fm::chisq->sig;}
+int Fminer::GetMeasure(){return fm::chisq->measure;}
 bool Fminer::GetLineNrs() {return fm::line_nrs;}
-bool Fminer::GetRegression() {return false;}
+bool Fminer::GetRegression() {return fm::regression;}
+unsigned int Fminer::GetMaxTime() {return fm::max_time;}
+bool Fminer::GetCancelled() {return fm::cancelled;}
+string Fminer::GetCheckpoint() {return fm::checkpoint_file;}
+unsigned int Fminer::GetCheckpointInterval() {return fm::checkpoint_interval;}
+unsigned int Fminer::GetShard() {return fm::shard;}
+unsigned int Fminer::GetShards() {return fm::shards;}
+bool Fminer::GetShardLegs() {return fm::shard_legs;}
+bool Fminer::GetShardBalance() {return fm::shard_balance;}
+bool Fminer::GetIncremental() {return fm::incremental != NULL;}
+bool Fminer::GetTidLocality() {return fm::tid_locality;}
+bool Fminer::GetEdgeOccurrences() {return fm::edge_occurrences;}
+unsigned int Fminer::GetEmbeddingMinSize() {return fm::embedding_min_size;}
+unsigned int Fminer::GetChisqTableSize() {return fm::chisq_table_size;}
+float Fminer::GetSample() {return fm::sample_rate;}
 
 
 
@@ -163,6 +219,7 @@ void Fminer::SetMinfreq(int val) {
     if (val < 1) { cerr << "Error! Invalid value '" << val << "' for parameter minfreq." << endl; exit(1); }
     if (val > 1 && GetRefineSingles()) { cerr << "Warning! Minimum frequency of '" << val << "' could not be set due to activated single refinement." << endl;}
     fm::minfreq = val;
+    fm::sample_minfreq = 0;
 }
 
 void Fminer::SetType(int val) {
@@ -231,6 +288,10 @@ void Fminer::SetMostSpecTreesOnly(bool val) {
     }
 }
 
+void Fminer::SetClosedOnly(bool val) {
+    fm::closed_only=val;
+}
+
 void Fminer::SetChisqActive(bool val) {
     fm::chisq->active = val;
     if (!GetChisqActive()) {
@@ -245,7 +306,14 @@ void Fminer::SetChisqActive(bool val) {
 
 void Fminer::SetChisqSig(float _chisq_val) {
     if (_chisq_val < 0.0 || _chisq_val > 1.0) { cerr << "Error! Invalid value '" << _chisq_val << "' for parameter chisq." << endl; exit(1); }
-    fm::chisq->sig = gsl_cdf_chisq_Pinv(_chisq_val, 1);
+    fm::chisq->confidence = _chisq_val;
+    fm::chisq->sig = SignificanceMeasure::Threshold(( fm::regression ? (int) SignificanceMeasure::CHISQ : fm::chisq->measure ), _chisq_val);
+}
+
+void Fminer::SetMeasure(int val) {
+    if (val < SignificanceMeasure::CHISQ || val > SignificanceMeasure::ODDSRATIO) { cerr << "Error! Invalid value '" << val << "' for parameter measure." << endl; exit(1); }
+    fm::chisq->measure = val;
+    if (!fm::regression) fm::chisq->sig = SignificanceMeasure::Threshold(val, fm::chisq->confidence);
 }
 
 void Fminer::SetLineNrs(bool val) {
@@ -253,29 +321,187 @@ void Fminer::SetLineNrs(bool val) {
 }
 
 void Fminer::SetRegression(bool val) {
-    // DO NOT USE REGRESSION IN ANY CASE
+    if (fm::chisq->n || fm::endpoints.size() > 1) { cerr << "Warning! Regression could not be set after adding activities." << endl; return; }
+    fm::regression = val;
+    // z^2 is compared to the chi-square distribution
+    fm::chisq->sig = SignificanceMeasure::Threshold(( val ? (int) SignificanceMeasure::CHISQ : fm::chisq->measure ), fm::chisq->confidence);
+}
+
+void Fminer::SetMaxTime(unsigned int val) {
+    if (init_mining_done) { cerr << "Warning! Time limit could not be set after mining has started." << endl; return; }
+    fm::max_time = val;
+}
+
+void Fminer::SetCheckpoint(string file) {
+    if (init_mining_done) { cerr << "Warning! Checkpoint file could not be set after mining has started." << endl; return; }
+    if (file.size() && !Checkpoint::Seekable()) { cerr << "Warning! Checkpoint file could not be set, output is not a regular file." << endl; return; }
+    fm::checkpoint_file = file;
+}
+
+void Fminer::SetCheckpointInterval(unsigned int val) {
+    fm::checkpoint_interval = val;
+}
+
+void Fminer::SetShard(unsigned int i, unsigned int n) {
+    if (n < 1 || i >= n) { cerr << "Error! Invalid shard '" << i << "/" << n << "'." << endl; exit(1); }
+    if (init_mining_done) { cerr << "Warning! Shard could not be set after mining has started." << endl; return; }
+    fm::shard = i;
+    fm::shards = n;
+    fm::shard_plan.clear();
+}
+
+void Fminer::SetShardLegs(bool val) {
+    if (init_mining_done) { cerr << "Warning! Shard legs could not be set after mining has started." << endl; return; }
+    fm::shard_legs = val;
+    fm::shard_plan.clear();
+}
+
+void Fminer::SetShardBalance(bool val) {
+    if (init_mining_done) { cerr << "Warning! Shard balancing could not be set after mining has started." << endl; return; }
+    fm::shard_balance = val;
+}
+
+void Fminer::SetTidLocality(bool val) {
+    if (init_database_done) { cerr << "Warning! Tid locality could not be set after mining has started." << endl; return; }
+    fm::tid_locality = val;
+}
+
+void Fminer::SetEdgeOccurrences(bool val) {
+    if (init_database_done) { cerr << "Warning! Edge occurrences could not be set after mining has started." << endl; return; }
+    fm::edge_occurrences = val;
+}
+
+void Fminer::SetEmbeddingMinSize(unsigned int val) {
+    fm::embedding_min_size = val;
+}
+
+void Fminer::SetChisqTableSize(unsigned int val) {
+    if (init_database_done) { cerr << "Warning! Chi-square table size could not be set after mining has started." << endl; return; }
+    fm::chisq_table_size = val;
+}
+
+void Fminer::SetSample(float rate, unsigned int seed) {
+    if (rate <= 0.0 || rate > 1.0) { cerr << "Error! Invalid value '" << rate << "' for parameter sample." << endl; exit(1); }
+    if (comp_runner || fm::database->trees.size() || fm::database->skipped) { cerr << "Warning! Sample could not be set after adding compounds." << endl; return; }
+    fm::sample_rate = rate;
+    fm::sample_seed = seed;
+}
+
+void Fminer::SetIncremental(bool val) {
+    if (comp_runner) { cerr << "Warning! Incremental mining could not be set after adding compounds." << endl; return; }
+    if (val && !fm::incremental) fm::incremental = new Incremental();
+    if (!val) { delete fm::incremental; fm::incremental = NULL; }
 }
 
 
 // 4. Other methods
 
+void Fminer::InitDatabase() {
+    if (init_database_done) return;
+    if (fm::chisq->active) {
+        each (fm::database->trees) {
+            if (fm::database->trees[i]->activity[0] == -1) {
+                cerr << "Error! ID " << fm::database->trees[i]->orig_tid << " is missing activity information." << endl;
+                exit(1);
+            }
+        }
+    }
+    // other endpoints may be unknown for some compounds
+    each (fm::database->trees) {
+        fm::database->trees[i]->activity.resize(fm::endpoints.size(), -1);
+        if (fm::regression) fm::database->trees[i]->value.resize(fm::endpoints.size(), 0.0);
+    }
+    for (unsigned int t = 1; t < fm::endpoints.size(); t++) {
+        fm::endpoints[t]->sig = fm::chisq->sig;
+        fm::endpoints[t]->active = fm::chisq->active;
+        fm::endpoints[t]->measure = fm::chisq->measure;
+    }
+    if (fm::regression) { each (fm::endpoints) fm::endpoints[i]->Moments(); }
+    else if (fm::sample_rate < 1.0) { each (fm::endpoints) fm::endpoints[i]->Weights(); } // weighted frequencies are not in the table
+    else each (fm::endpoints) if (fm::endpoints[i]->active && fm::endpoints[i]->measure == SignificanceMeasure::CHISQ) fm::endpoints[i]->Tabulate(fm::chisq_table_size);
+    if (fm::sample_rate < 1.0) {
+        // frequencies in the sample are expected to shrink by the sampled fraction
+        unsigned int all = fm::database->trees.size() + fm::database->skipped;
+        fm::sample_minfreq = fm::minfreq;
+        fm::minfreq = (unsigned int) ( fm::minfreq * fm::database->trees.size() / (float) all + 0.5 );
+        if (fm::minfreq < 1) fm::minfreq = 1;
+        cerr << "Notice: Mining a sample of " << fm::database->trees.size() << " of " << all << " compounds with minimum frequency " << fm::minfreq << "." << endl;
+    }
+    fm::database->edgecount (); 
+    if (fm::tid_locality && !fm::incremental) fm::database->localize (); // incremental mode relies on new compounds having the last tids
+    fm::database->reorder (); 
+    initLegStatics (); 
+    fm::graphstate->init (); 
+    init_database_done = true;
+}
+
+// per root leg, in the order of Path::expand
+void Fminer::EstimateCosts(vector<vector<float> >& leg_costs) {
+    InitDatabase();
+    leg_costs.clear();
+    for (unsigned int j = 0; j < fm::database->nodelabels.size(); j++) {
+        if ( fm::database->nodelabels[j].frequency >= fm::minfreq && fm::database->nodelabels[j].frequentedgelabels.size () ) {
+            Path path(j);
+            leg_costs.push_back(path.costs(8));
+        }
+        else leg_costs.push_back(vector<float>(fm::database->nodelabels[j].frequentedgelabels.size(), 0.0));
+    }
+}
+
+vector<float> Fminer::GetRootCosts() {
+    vector<vector<float> > leg_costs;
+    EstimateCosts(leg_costs);
+    vector<float> costs(leg_costs.size(), 0.0);
+    each (leg_costs) {
+        for (unsigned int l = 0; l < leg_costs[i].size(); l++) costs[i] += leg_costs[i][l];
+    }
+    return costs;
+}
+
+// longest processing time first: the most expensive item goes to the least loaded shard
+vector<unsigned int> Fminer::GetShardPlan() {
+    if (!fm::shard_plan.size()) {
+        vector<vector<float> > leg_costs;
+        EstimateCosts(leg_costs);
+        vector<pair<float, unsigned int> > items;
+        unsigned int k = 0;
+        each (leg_costs) {
+            float c = 0.0;
+            for (unsigned int l = 0; l < leg_costs[i].size(); l++) {
+                if (fm::shard_legs) items.push_back(make_pair(leg_costs[i][l], k++));
+                else c += leg_costs[i][l];
+            }
+            if (!fm::shard_legs) items.push_back(make_pair(c, k++));
+        }
+        sort(items.rbegin(), items.rend());
+        vector<float> load(fm::shards, 0.0);
+        fm::shard_plan.assign(items.size(), 0);
+        each (items) {
+            unsigned int s = min_element(load.begin(), load.end()) - load.begin();
+            fm::shard_plan[items[i].second] = s;
+            load[s] += items[i].first;
+        }
+        cerr << "Shard plan (estimated cost per shard):";
+        each (load) cerr << " " << load[i];
+        cerr << endl;
+    }
+    return fm::shard_plan;
+}
+
 vector<string>* Fminer::MineRoot(unsigned int j) {
     fm::result->clear();
     if (!init_mining_done) {
-        if (fm::chisq->active) {
-            each (fm::database->trees) {
-                if (fm::database->trees[i]->activity == -1) {
-                    cerr << "Error! ID " << fm::database->trees[i]->orig_tid << " is missing activity information." << endl;
-                    exit(1);
-                }
-            }
+        InitDatabase();
+        if (fm::shard_balance) GetShardPlan();
+        if (fm::incremental) {
+            fm::incremental->Prepare();
+            if (fm::checkpoint_file.size()) { cerr << "Notice: Disabling checkpoints in incremental mode." << endl; fm::checkpoint_file = ""; }
         }
-        fm::database->edgecount (); 
-        fm::database->reorder (); 
-        initLegStatics (); 
-        fm::graphstate->init (); 
+        if (fm::checkpoint_file.size() && (!fm::console_out || !Checkpoint::Seekable())) { cerr << "Notice: Disabling checkpoints, output is not written to a regular file." << endl; fm::checkpoint_file = ""; }
         if (fm::bbrc_sep && fm::do_output && !fm::console_out) (*fm::result) << fm::graphstate->sep();
         init_mining_done=true; 
+        if (fm::max_time) fm::deadline = time(NULL) + fm::max_time;
+        if (fm::checkpoint_file.size()) fm::checkpoint = new Checkpoint(fm::checkpoint_file, fm::checkpoint_interval);
         cerr << "Settings:" << endl \
              << "---" << endl \
              << "Chi-square active (chi-square-value): " << GetChisqActive() << " (" << GetChisqSig()<< ")" << endl \
@@ -283,25 +509,47 @@ vector<string>* Fminer::MineRoot(unsigned int j) {
              << "Minimum frequency: " << GetMinfreq() << endl \
              << "---" << endl;
 
-        cout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
-        cout << "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\"\n    xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n    xsi:noNamespaceSchemaLocation=\"graphml.xsd\">" << endl << endl;
-
-        cout << "<!-- LAtent STructure Mining (LAST) descriptors-->" << endl << endl;
-        cout << "<key id=\"act\" for=\"graph\" attr.name=\"activating\" attr.type=\"boolean\" />" << endl;
-        cout << "<key id=\"hops\" for=\"graph\" attr.name=\"hops\" attr.type=\"int\" />" << endl;
-        cout << "<key id=\"lab_n\" for=\"node\" attr.name=\"node_labels\" attr.type=\"string\" />" << endl;
-        cout << "<key id=\"lab_e\" for=\"edge\" attr.name=\"edge_labels\" attr.type=\"string\" />" << endl;
-        cout << "<key id=\"weight\" for=\"edge\" attr.name=\"edge_weight\" attr.type=\"int\" />" << endl;
-        cout << "<key id=\"del\" for=\"edge\" attr.name=\"edge_deleted\" attr.type=\"boolean\" />" << endl;
+        if (fm::checkpoint && fm::checkpoint->Resumed()) fm::checkpoint->Restore(); // header already written
+        else {
+            cout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
+            cout << "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\"\n    xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n    xsi:noNamespaceSchemaLocation=\"graphml.xsd\">" << endl << endl;
+
+            cout << "<!-- LAtent STructure Mining (LAST) descriptors-->" << endl << endl;
+            cout << "<key id=\"act\" for=\"graph\" attr.name=\"activating\" attr.type=\"boolean\" />" << endl;
+            cout << "<key id=\"hops\" for=\"graph\" attr.name=\"hops\" attr.type=\"int\" />" << endl;
+            cout << "<key id=\"lab_n\" for=\"node\" attr.name=\"node_labels\" attr.type=\"string\" />" << endl;
+            cout << "<key id=\"lab_e\" for=\"edge\" attr.name=\"edge_labels\" attr.type=\"string\" />" << endl;
+            cout << "<key id=\"weight\" for=\"edge\" attr.name=\"edge_weight\" attr.type=\"int\" />" << endl;
+            cout << "<key id=\"del\" for=\"edge\" attr.name=\"edge_deleted\" attr.type=\"boolean\" />" << endl;
+            if (fm::endpoints.size() > 1) cout << "<key id=\"target\" for=\"graph\" attr.name=\"target\" attr.type=\"int\" />" << endl;
+            if (fm::edge_occurrences) {
+                cout << "<key id=\"occ_a\" for=\"edge\" attr.name=\"edge_occurrences_active\" attr.type=\"string\" />" << endl;
+                cout << "<key id=\"occ_i\" for=\"edge\" attr.name=\"edge_occurrences_inactive\" attr.type=\"string\" />" << endl;
+            }
+            if (fm::incremental && fm::incremental->updating) cout << "<key id=\"delta\" for=\"graph\" attr.name=\"delta\" attr.type=\"string\" />" << endl;
+            if (fm::checkpoint) fm::checkpoint->Start();
+        }
+        output_open = true;
 
 
     }
     if (j >= fm::database->nodelabels.size()) { cerr << "Error! Root node does not exist." << endl;  exit(1); }
-    if ( fm::database->nodelabels[j].frequency >= fm::minfreq && fm::database->nodelabels[j].frequentedgelabels.size () ) {
+    bool done = (fm::checkpoint && fm::checkpoint->RootDone(j));
+    bool in_shard = (fm::shard_legs || (fm::shard_balance ? fm::shard_plan[j] : j % fm::shards) == fm::shard);
+    bool affected = (!fm::incremental || fm::incremental->Affected(j));
+    fm::shard_root = j;
+    if (fm::incremental) fm::incremental->Begin(); // output is kept for the next update
+    if ( !fm::cancelled && !done && in_shard && affected && fm::database->nodelabels[j].frequency >= fm::minfreq && fm::database->nodelabels[j].frequentedgelabels.size () ) {
         Path path(j);
         path.expand(); // mining step
     }
-    if (j==GetNoRootNodes()-1) cout << "</graphml>" << endl;
+    if (fm::incremental) fm::incremental->End(j, affected);
+    if (fm::checkpoint && !fm::cancelled && !done) fm::checkpoint->Root(j);
+    // a cancelled run closes the document early, later calls return nothing
+    if (output_open && (j==GetNoRootNodes()-1 || fm::cancelled)) {
+        cout << "</graphml>" << endl;
+        output_open = false;
+    }
     return fm::result;
 }
 
@@ -309,9 +557,38 @@ void Fminer::ReadGsp(FILE* gsp){
     fm::database->readGsp(gsp);
 }
 
+void Fminer::Update() {
+    if (!fm::incremental) { cerr << "Error! Update requires incremental mining." << endl; exit(1); }
+    if (!init_mining_done) { cerr << "Warning! Nothing mined yet, no update necessary." << endl; return; }
+    // rebuild from scratch, keeping settings and the state of the last run
+    Incremental* incremental = fm::incremental;
+    float sig = fm::chisq->sig; bool active = fm::chisq->active; bool pruning = fm::do_pruning;
+    int measure = fm::chisq->measure; float confidence = fm::chisq->confidence;
+    fm::incremental = NULL;
+    Reset();
+    fm::chisq->sig = sig; fm::chisq->active = active; fm::do_pruning = pruning;
+    fm::chisq->measure = measure; fm::chisq->confidence = confidence;
+    each (incremental->compounds) AddCompound(incremental->compounds[i].second, incremental->compounds[i].first);
+    each (incremental->activities) AddActivity(incremental->activities[i].second, incremental->activities[i].first);
+    fm::incremental = incremental;
+    fm::incremental->updating = true;
+}
+
 bool Fminer::AddCompound(string smiles, unsigned int comp_id) {
+    if (fm::incremental) {
+        fm::incremental->compounds.push_back(make_pair(comp_id, smiles));
+        if (init_mining_done) { // added by the next Update(), just check it
+            Database check;
+            return (comp_id>0 && check.readTreeSmi(smiles, 0, comp_id, 0));
+        }
+    }
     bool insert_done=false;
     if (comp_id<=0) { cerr << "Error! IDs must be of type: Int > 0." << endl;}
+    else if (!Database::sampled(comp_id)) { // not parsed
+        fm::database->skipped++;
+        insert_done=true;
+        comp_runner++;
+    }
     else {
         if (fm::database->readTreeSmi (smiles, comp_no, comp_id, comp_runner)) {
             insert_done=true;
@@ -337,17 +614,48 @@ bool Fminer::AddActivity(bool act, unsigned int comp_id) {
 */
 
 bool Fminer::AddActivity(float act, unsigned int comp_id) {
+    return AddActivity(act, comp_id, 0);
+}
+
+bool Fminer::AddActivity(float act, unsigned int comp_id, unsigned int target) {
+    if (target && fm::incremental) { cerr << "Error! Multi-target mining is not available in incremental mode." << endl; exit(1); }
+    if (target >= fm::endpoints.size() && init_database_done) { cerr << "Warning! Target " << target << " could not be added after mining has started." << endl; return false; }
+    if (target > fm::endpoints.size()) { cerr << "Warning! Target " << target << " could not be added before target " << fm::endpoints.size() << ". Ignoring entry!" << endl; return false; }
+    if (fm::incremental) {
+        fm::incremental->activities.push_back(make_pair(comp_id, act));
+        if (init_mining_done) return true; // added by the next Update()
+    }
     
-    if (fm::database->trees_map[comp_id] == NULL) { 
+    DatabaseTreePtr tree = fm::database->trees_map[comp_id];
+    // compounds not in the sample count for the class sizes only
+    bool skipped = ( tree == NULL && !Database::sampled(comp_id) );
+    if (tree == NULL && !skipped) { 
         cerr << "No structure for ID " << comp_id << ". Ignoring entry!" << endl; return false; 
     }
     else {
         bool act_b=false; 
         if (act == 1.0) act_b=true; 
-        else { if (act!=0.0) { cerr << "Error! Unknown activity " << act << "." << endl; exit(1); } }
-
-        if ((fm::database->trees_map[comp_id]->activity = act_b)) AddChiSqNa();
-        else AddChiSqNi();
+        else { if (act!=0.0 && !fm::regression) { cerr << "Error! Unknown activity " << act << "." << endl; exit(1); } }
+
+        if (target == fm::endpoints.size()) fm::endpoints.push_back(new ChisqConstraint(fm::chisq->sig, fm::endpoints.size()));
+        if (skipped) {
+            if (fm::regression) fm::endpoints[target]->n++;
+            else if (act_b) AddChiSqNa(target);
+            else AddChiSqNi(target);
+            return true;
+        }
+        vector<int>& activity = tree->activity;
+        if (activity.size() <= target) activity.resize(target+1, -1);
+
+        // regression: the class sizes are set by ChisqConstraint::Moments()
+        if (fm::regression) {
+            vector<float>& value = tree->value;
+            if (value.size() <= target) value.resize(target+1, 0.0);
+            value[target] = act; activity[target] = 1;
+            fm::endpoints[target]->n++;
+        }
+        else if ((activity[target] = act_b)) AddChiSqNa(target);
+        else AddChiSqNi(target);
 
         return true;
     }
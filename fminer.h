@@ -30,9 +30,11 @@ namespace fm {
     extern bool do_pruning;
     extern bool aromatic;
     extern ChisqConstraint* chisq;
+    extern vector<ChisqConstraint*> endpoints;
     extern bool gsp_out;
     extern bool bbrc_sep;
     extern bool line_nrs;
+    extern volatile bool cancelled;
 
 }
 class Fminer {
@@ -67,10 +69,26 @@ class Fminer {
     bool GetDoOutput(); //!< Get whether output is enabled.
     bool GetBbrcSep(); //!< Get whether BBRCs should be separated in the output.
     bool GetMostSpecTreesOnly(); //!< Get whether most specific trees only should be mined for every BBRC.
+    bool GetClosedOnly(); //!< Get whether significant patterns that are not closed are left out.
     bool GetChisqActive(); //!< Get whether chi-square filter is active.
     float GetChisqSig(); //!< Get significance threshold.
+    int GetMeasure(); //!< Get significance measure (see SetMeasure()).
     bool GetLineNrs(); //!< Get whether line numbers should be used in the output file.
-    bool GetRegression(); //!< Dummy method for regression (only used for bbrcs).
+    bool GetRegression(); //!< Get whether activities are continuous (regression mode).
+    unsigned int GetMaxTime(); //!< Get wall-clock time limit for mining in seconds (0 means unlimited).
+    bool GetCancelled(); //!< Get whether mining was cancelled or stopped by the time limit.
+    string GetCheckpoint(); //!< Get checkpoint file name (empty if checkpointing is disabled).
+    unsigned int GetCheckpointInterval(); //!< Get minimum number of seconds between checkpoints inside a root.
+    unsigned int GetShard(); //!< Get index of the shard mined by this process.
+    unsigned int GetShards(); //!< Get number of shards (1 means no sharding).
+    bool GetShardLegs(); //!< Get whether shards are made of root-plus-first-edge pairs instead of roots.
+    bool GetShardBalance(); //!< Get whether shards are balanced by estimated cost.
+    bool GetIncremental(); //!< Get whether incremental mining is enabled.
+    bool GetTidLocality(); //!< Get whether trees are renumbered to cluster similar compounds.
+    bool GetEdgeOccurrences(); //!< Get whether the occurrences of each edge are tracked and output.
+    unsigned int GetEmbeddingMinSize(); //!< Get pattern size from which embedded nodes are looked up in a node map (0 means never).
+    unsigned int GetChisqTableSize(); //!< Get maximum number of (active, inactive) frequency pairs for which chi-square values are precomputed.
+    float GetSample(); //!< Get fraction of the compounds that is mined (1 means all).
 
     //@}
 
@@ -89,10 +107,24 @@ class Fminer {
     void SetDoOutput(bool val); //!< Pass 'false' here to disable output.
     void SetBbrcSep(bool val); //!< Set this to 'true' to enable BBRC separators in output.
     void SetMostSpecTreesOnly(bool val); //!< Set this to 'true' to enable mining for the most specific tree patterns only.
+    void SetClosedOnly(bool val); //!< Set this to 'true' to leave significant patterns out of the descriptors if a refinement found by the search occurs in the same compounds (it has the same significance and is used instead). Requires the chi-square filter.
     void SetChisqActive(bool val); //!< Set this to 'true' to enable chi-square filter.
     void SetChisqSig(float _chisq_val); //!< Set significance threshold here (between 0 and 1).
+    void SetMeasure(int val); //!< Set significance measure used by the chi-square filter and its pruning: 0 chi-square (default), 1 one-sided Fisher exact test, 2 information gain (G-test), 3 odds ratio (Woolf test). The significance threshold applies to all.
     void SetLineNrs(bool val); //!< Set 'true' here to enable line numbers in the output file.
-    void SetRegression(bool val); //!< Dummy method for regression (only used for bbrcs).
+    void SetRegression(bool val); //!< Set 'true' here before adding activities to enable regression: activities are arbitrary numbers, and fragments are scored by the z-test of the difference in mean activity between the compounds that contain them and the others (squared, compared to the chi-square threshold of the significance level, and pruned by its upper bound). Activating means an above-average mean activity. The measure is ignored.
+    void SetMaxTime(unsigned int val); //!< Set wall-clock time limit for mining in seconds, counted from the first call to MineRoot() (0 disables the limit).
+    void SetCheckpoint(string file); //!< Set checkpoint file to record completed roots and first-level legs. If the file exists, mining resumes from it: output must be appended to the output file of the interrupted run (same input and settings). Only available with console output to a regular file (stdout redirected to a file, not a pipe or terminal), since the output is truncated to the last recorded position on resume.
+    void SetCheckpointInterval(unsigned int val); //!< Set minimum number of seconds between checkpoints inside a root (completed roots are always recorded).
+    void SetShard(unsigned int i, unsigned int n); //!< Mine only shard i of n (0 <= i < n). Run one process per shard on the same input and settings, then combine the outputs with the 'last-merge' tool.
+    void SetShardLegs(bool val); //!< Set 'true' here to shard on root-plus-first-edge pairs (finer grained). Descriptors are not merged across first edges of different shards: where an unsharded run merges adjacent first edges that fall into different shards, each shard outputs its part as a separate descriptor, so the merged output differs from an unsharded run.
+    void SetShardBalance(bool val); //!< Set 'true' here to assign roots (or root-plus-first-edge pairs) to shards by estimated cost instead of round robin (see GetShardPlan()).
+    void SetTidLocality(bool val); //!< Set 'true' here to renumber the compounds internally such that compounds with similar atoms are neighbours, which improves memory locality of the search (output is unchanged, ignored in incremental mode).
+    void SetEdgeOccurrences(bool val); //!< Set 'true' here to track for each descriptor edge the compounds (ids and weights, active and inactive) it occurs in, and to output them in the 'occ_a' and 'occ_i' edge keys (costs memory and time in merging).
+    void SetEmbeddingMinSize(unsigned int val); //!< Set pattern size (number of nodes) from which extensions look up the nodes of an occurrence in a node map instead of walking its parent occurrences (0 disables the map).
+    void SetChisqTableSize(unsigned int val); //!< Set maximum number of (active, inactive) frequency pairs, i.e. (na+1)*(ni+1), for which chi-square values are precomputed once per endpoint instead of calculated for every pattern (0 disables the table, larger datasets are always calculated).
+    void SetIncremental(bool val); //!< Set 'true' here before adding compounds to enable incremental mining: after a complete run, more compounds and activities may be added and mined with Update().
+    void SetSample(float rate, unsigned int seed); //!< Set before adding compounds to mine an approximation on a random sample: each compound is kept with probability 'rate', decided by its id and 'seed'. Activities of all compounds must still be added. The sample is not stratified, since activities are not known when compounds are added: each activity class is weighted afterwards by its size over its size in the sample for the significance (post-stratification; a class without sampled compounds is warned about, small classes need a higher rate). The minimum frequency is scaled to the sample (in regression, the statistic is scaled by the size of the data over the size of the sample). Output frequencies and weights are those in the sample.
     //@}
     
     /** @name Others
@@ -103,15 +135,26 @@ class Fminer {
     void ReadGsp(FILE* gsp); //!< Read in a gSpan file
     bool AddCompound(string smiles, unsigned int comp_id); //!< Add a compound to the database.
     bool AddActivity(float act, unsigned int comp_id); //!< Add an activity to the database.
+    bool AddActivity(float act, unsigned int comp_id, unsigned int target); //!< Add an activity for endpoint 'target' to the database (0 is the endpoint of AddActivity(act, comp_id)). Targets are numbered consecutively: a new target is only accepted as the next unused index. All endpoints are mined in one search, the descriptors of each are output separately with graph data 'target'. Compounds without activity for an endpoint other than 0 are ignored for it (not available in incremental mode).
+    void Update(); //!< Incremental mode: rebuild the database with the compounds and activities added since the last run. The following MineRoot() calls mine only roots whose descriptors can change and output the differences to the last run (graph data 'delta': added, removed, changed).
+    void Cancel() {fm::cancelled=true;} //!< Stop mining at the next refinement (may be called from a signal handler or another thread). Fragments found so far are kept and the output is closed.
     int GetNoRootNodes() {return fm::database->nodelabels.size();} //!< Get number of root nodes (different element types).
     int GetNoCompounds() {return fm::database->trees.size();} //!< Get number of compounds in the database.
+    unsigned int GetNoTargets() {return fm::endpoints.size();} //!< Get number of activity endpoints.
+    vector<float> GetRootCosts(); //!< Estimate the mining cost of every root node from edge label frequencies and a shallow expansion of sampled root legs.
+    vector<unsigned int> GetShardPlan(); //!< Get balanced assignment of roots (or root-plus-first-edge pairs with SetShardLegs()) to the shards set with SetShard(). Identical for every shard on the same input and settings.
     //@}
     
   private:
-    void AddChiSqNa(){fm::chisq->na++;fm::chisq->n++;}
-    void AddChiSqNi(){fm::chisq->ni++;fm::chisq->n++;}
+    void AddChiSqNa(unsigned int t){fm::endpoints[t]->na++;fm::endpoints[t]->n++;}
+    void AddChiSqNi(unsigned int t){fm::endpoints[t]->ni++;fm::endpoints[t]->n++;}
 
+    void InitDatabase();
+    void EstimateCosts(vector<vector<float> >& leg_costs);
+
+    bool init_database_done;
     bool init_mining_done;
+    bool output_open;
     int comp_runner;
     int comp_no;
 
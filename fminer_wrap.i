@@ -10,5 +10,7 @@ using namespace std;
 
 %include "std_vector.i"
 %template(SVector) std::vector<std::string>;
+%template(FVector) std::vector<float>;
+%template(UVector) std::vector<unsigned int>;
 
 %include "fminer.h"
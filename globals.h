@@ -23,6 +23,8 @@
 
 #include "database.h"
 #include "constraints.h"
+#include "checkpoint.h"
+#include "incremental.h"
 
 namespace fm {
 
@@ -38,24 +40,53 @@ namespace fm {
     bool gsp_out;
     bool bbrc_sep;
     bool most_specific_trees_only;
+    bool closed_only;
     bool line_nrs;
     int die;
     bool do_last;
     unsigned int last_hops;
+    volatile bool cancelled;
+    unsigned int max_time;
+    time_t deadline;
+    unsigned int gsw_counter=0;
+    string checkpoint_file;
+    unsigned int checkpoint_interval;
+    unsigned int shard;
+    unsigned int shards;
+    bool shard_legs;
+    unsigned int shard_root;
+    unsigned int shard_leg;
+    bool shard_balance;
+    vector<unsigned int> shard_plan;
 
     Database* database=NULL;
     Statistics* statistics=NULL;
     ChisqConstraint* chisq=NULL;
+    vector<ChisqConstraint*> endpoints; // one per activity target, the first is chisq
     GraphState* graphstate=NULL;
     CloseLegOccurrences* closelegoccurrences=NULL; 
     LegOccurrences* legoccurrences=NULL;
+    Checkpoint* checkpoint=NULL;
+    Incremental* incremental=NULL;
 
     vector<string>* result=NULL;
     vector<LegOccurrences> candidatelegsoccurrences;
+    vector<EdgeLabel> candidatelegstouched;
+    vector<bool> candidatelegsmarked;
+    vector<Tid> candidatelegslastself;
+    unsigned int embedding_min_size;
+    unsigned int chisq_table_size;
+    bool tid_locality;
+    bool edge_occurrences;
+    bool regression;
+    float sample_rate;
+    unsigned int sample_seed;
+    unsigned int sample_minfreq; // minfreq as set, while fm::minfreq is scaled to the sample
+    vector<int> embeddingnumber;
+    vector<unsigned int> embeddingstamp;
+    unsigned int embeddingclock=0;
     vector<vector< CloseLegOccurrences> > candidatecloselegsoccs;
-    vector<bool> candidatecloselegsoccsused;
-
-    bool closelegsoccsused;
+    vector<pair<int, EdgeLabel> > candidatecloselegstouched;
 
 }
 
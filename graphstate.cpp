@@ -36,7 +36,7 @@ namespace fm {
     extern int die;
 }
 
-GraphState::GraphState () {
+GraphState::GraphState () : normalizelevel ( 0 ) {
 }
 
 void GraphState::init () {
@@ -223,12 +223,18 @@ int GraphState::is_normal () {
 }
 
 void GraphState::determineCycles ( unsigned int usedbit ) { 
-  int nodestack[edgessize+1];
-  int edgestack[edgessize+1];
+  if ( (int) cyclenodestack.size () < edgessize + 2 ) {
+    cyclenodestack.resize ( edgessize + 2 );
+    cycleedgestack.resize ( edgessize + 2 );
+  }
+  if ( cycleinstack.size () < nodes.size () )
+    cycleinstack.resize ( nodes.size () );
+  int *nodestack = &cyclenodestack[0];
+  int *edgestack = &cycleedgestack[0];
   int stacktop = 1;
   nodestack[0] = edgestack[0] = -1; // to allow look at of array
   nodestack[1] = edgestack[1] = 0;
-  bool instack[nodes.size ()];
+  char *instack = &cycleinstack[0];
   unsigned int deletebit = ~usedbit;
   
   for ( int i = 0; i < (int) nodes.size (); i++ ) {
@@ -353,7 +359,7 @@ void GraphState::print ( FILE *f ) {
 
 // GENERATE VECTOR REPRESENTATIONS FOR LATENT STRUCTURE MINING
 
-void GraphState::print ( GSWalk* gsw, map<Tid, int> weightmap_a, map<Tid, int> weightmap_i ) {
+void GraphState::print ( GSWalk* gsw, const TidWeights& weightmap_a, const TidWeights& weightmap_i ) {
 
   // convert occurrence lists to weight maps
   for ( int i = 0; i < (int) nodes.size (); i++ ) {
@@ -680,14 +686,31 @@ void GraphState::undoState () {
   deleteStartNode ();
 }
 
+// Grows the buffers to the largest pattern seen so far; arrays are handed out in order.
+// Per node normalizetree needs 25 ints (+1), 3 edge labels (+2), 2 flags and 3 pointers (+1).
+void GraphState::NormalizeBuffers::reserve ( unsigned int nrnodes, unsigned int nrclose ) {
+  if ( intbuf.size () < 25 * nrnodes + 1 ) {
+    intbuf.resize ( 25 * nrnodes + 1 );
+    labelbuf.resize ( 3 * nrnodes + 2 );
+    flagbuf.resize ( 2 * nrnodes );
+    pointerbuf.resize ( 3 * nrnodes + 1 );
+  }
+  if ( closebuf.size () < nrclose )
+    closebuf.resize ( nrclose );
+  intwalk = labelwalk = flagwalk = pointerwalk = 0;
+}
+
 // In this function the real work is done. Currently it is one function (645 lines),
 // as many arrays are reused. This choice was made because this setup is more
 // efficient (but less readable, unfortunately).
 int GraphState::normalizetree () {
   unsigned int nrnodes = nodes.size ();
-  int distmarkers[nrnodes];
-  int adjacentdones[nrnodes];
-  int queue[nrnodes];
+  NormalizeLevel level ( normalizelevel );
+  NormalizeBuffers &buffers = normalizebuffers[normalizelevel-1];
+  buffers.reserve ( nrnodes, deletededges.size () );
+  int *distmarkers = buffers.ints ( nrnodes );
+  int *adjacentdones = buffers.ints ( nrnodes );
+  int *queue = buffers.ints ( nrnodes );
   int queuebegin = 0;
   int queueend = 0;
   for ( int i = 0; i < (int) nrnodes; i++ )
@@ -771,28 +794,28 @@ int GraphState::normalizetree () {
     if ( rl > bicenterlabel )
       return 0;
   }
-  int nodes[nrnodes];
-  int *depthnodes[maxdepth + 1]; // we sometimes overshoot this fill in, allthough we do not use the type 
+  int *nodes = buffers.ints ( nrnodes );
+  int **depthnodes = buffers.pointers ( maxdepth + 1 ); // we sometimes overshoot this fill in, allthough we do not use the type 
                                  // This array is used to find the nodes for each type of the spanning
 				 // tree that we are currently considering
-  int depthnodessizes[maxdepth + 1];
-  int minlabelednodes[2][nrnodes];
+  int *depthnodessizes = buffers.ints ( maxdepth + 1 );
+  int *minlabelednodes[2] = { buffers.ints ( nrnodes ), buffers.ints ( nrnodes ) };
   int minlabelednodessize[2] = { 0, 0 };
-  int children[nrnodes];
+  int *children = buffers.ints ( nrnodes );
   int nodewalk;
-  EdgeLabel pathedgelabels[2][nrnodes+1];
+  EdgeLabel *pathedgelabels[2] = { buffers.labels ( nrnodes + 1 ), buffers.labels ( nrnodes + 1 ) };
   int pathedgelabelssize = 1;
   for ( int i = 0; i < (int) maxdepth + 1; i++ ) 
     depthnodessizes[i] = 0;
   
-  int* nodes_firstchild[nrnodes];
-  int nodes_nochildren[nrnodes];
-  int nodes_walkchild[nrnodes];
-  int nodes_parent[nrnodes];
-  EdgeLabel nodes_edgelabel[nrnodes];
-  int nodes_code[nrnodes];
-  int nodes_treenr[nrnodes];
-  int nodes_marker[nrnodes];
+  int **nodes_firstchild = buffers.pointers ( nrnodes );
+  int *nodes_nochildren = buffers.ints ( nrnodes );
+  int *nodes_walkchild = buffers.ints ( nrnodes );
+  int *nodes_parent = buffers.ints ( nrnodes );
+  EdgeLabel *nodes_edgelabel = buffers.labels ( nrnodes );
+  int *nodes_code = buffers.ints ( nrnodes );
+  int *nodes_treenr = buffers.ints ( nrnodes );
+  int *nodes_marker = buffers.ints ( nrnodes );
   int lowesttreenr=0;
   int lowestlabel, secondlowestlabel;
   
@@ -1032,7 +1055,7 @@ int GraphState::normalizetree () {
   
   // here we have in minlabelednodes the leafs at maximal depth for the lowest path
   // next, we're going bottom-up through the tree
-  bool equal[nrnodes];
+  char *equal = buffers.flags ( nrnodes );
   
   for ( Depth depth = maxdepth - 1; ; depth-- ) {
     // sort the nodes at that type using insertion sort
@@ -1108,9 +1131,9 @@ int GraphState::normalizetree () {
   }
   
   // print string, put in classes at the same time?
-  int stack[nrnodes];
-  int depths[nrnodes];
-  int preordernumber[nrnodes];
+  int *stack = buffers.ints ( nrnodes );
+  int *depths = buffers.ints ( nrnodes );
+  int *preordernumber = buffers.ints ( nrnodes );
   
   int stacksize = 0;
   for ( int r = depthnodessizes[0] - 1; r >= 0; r-- ) {
@@ -1182,7 +1205,7 @@ int GraphState::normalizetree () {
       return b;
   }
   
-  bool nodeclose[nrnodes];
+  char *nodeclose = buffers.flags ( nrnodes );
   for ( int i = 0; i < (int) nrnodes; i++ )
     nodeclose[i] = false;
   
@@ -1199,12 +1222,12 @@ int GraphState::normalizetree () {
     }
   }
   
-  int *siblingstack[nrnodes];
-  int siblingstacksize[nrnodes];
-  int btcode[2 * nrnodes];
-  int btparent[2 * nrnodes];
+  int **siblingstack = buffers.pointers ( nrnodes );
+  int *siblingstacksize = buffers.ints ( nrnodes );
+  int *btcode = buffers.ints ( 2 * nrnodes );
+  int *btparent = buffers.ints ( 2 * nrnodes );
   int btcodesize = 0;
-  int nodesinbt[nrnodes];
+  int *nodesinbt = buffers.ints ( nrnodes );
   siblingstack[0] = depthnodes[0];
   siblingstacksize[0] = depthnodessizes[0];
   stacksize = 1;
@@ -1257,8 +1280,8 @@ int GraphState::normalizetree () {
     nodesinbt[queue[queuebegin]] = NONODE;
     
   // walk through all permutations, for each determine the coding of the closings
-  int permstack[btcodesize];
-  CloseTuple closetuples[deletededges.size ()];
+  int *permstack = buffers.ints ( btcodesize );
+  CloseTuple *closetuples = buffers.closebuf.empty () ? NULL : &buffers.closebuf[0]; // no closings: never read
   stacksize = 1;
   permstack[0] = 0;
   while ( true ) {
@@ -1353,318 +1376,260 @@ void GraphState::puti ( FILE *f, int i ) {
   } while ( k ); 
 }
 
+// Scratch space of conflict_resolution, reused by all calls. Node id sets are sorted vectors.
+struct CRFrame {
+    vector<int> core_ids;
+    vector<int> u12; // the incremental union set over both d12 and d21 and j (includes mutex and node conflict edges)
+    vector<pair<int, int> > stack_locations; // sorted by to, one from per to
+    //          ^^^  ^^^
+    //          to   from
+    int ceiling;
+    bool starting, resuming;
+    int next_to, c; // bag resolved by the frame above
+};
+
+static vector<CRFrame> crframes;
+static vector<pair<int, int> > crinsert21, crinsert12, crc12_inc; // (to, from)
+static vector<int> crindex_revisit; // core ids, ascending
+
+// Node id sets of the core loop are bitsets (node ids of a walk are small and dense), such that
+// intersections and differences are word-wise AND / AND NOT.
+typedef unsigned long CRWord;
+#define CRWORDBITS ( 8 * sizeof ( CRWord ) )
+static vector<CRWord> crd1, crd2, crcore, cru12;
+
+static inline void crbits (const map<int, GSWEdge>& edges, vector<CRWord>& bits) {
+    for (map<int, GSWEdge>::const_iterator it = edges.begin(); it != edges.end(); it++) bits[it->first / CRWORDBITS] |= (CRWord) 1 << (it->first % CRWORDBITS);
+}
+
+// bits of node ids >= from (and < to, if to > 0) in word w
+static inline CRWord crrange (unsigned int w, int from, int to) {
+    CRWord mask = ~ (CRWord) 0;
+    int lo = w * CRWORDBITS;
+    if (from >= lo + (int) CRWORDBITS) return 0;
+    if (from > lo) mask &= ~ (CRWord) 0 << (from - lo);
+    if (to > 0) {
+        if (to <= lo) return 0;
+        if (to < lo + (int) CRWORDBITS) mask &= ~ ( ~ (CRWord) 0 << (to - lo) );
+    }
+    return mask;
+}
+
+static inline bool crto_less (const pair<int, int>& a, const pair<int, int>& b) { return a.first < b.first; }
+
+static inline void crinsert (vector<int>& ids, int id) {
+    vector<int>::iterator it = lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id) ids.insert(it, id);
+}
+
+// stack_locations[to]=from
+static inline void crlocate (vector<pair<int, int> >& locations, int to, int from) {
+    vector<pair<int, int> >::iterator it = lower_bound(locations.begin(), locations.end(), make_pair(to, 0), crto_less);
+    if (it != locations.end() && it->first == to) it->second = from;
+    else locations.insert(it, make_pair(to, from));
+}
+
+// label-less edge and node inserted by conflict resolution (labels are stacked afterwards)
+static GSWEdge crempty_edge = { 0, set<InputEdgeLabel>(), TidWeights(), TidWeights(), 0, 0 };
+static const GSWNode crempty_node = { set<InputNodeLabel>() };
+
 //! s-sided stack of two features by walking core ids
 //  NOTE: s is intended to 'carry' the growing meta pattern
-//  starting=1: indicate that this is iteration 0, i.e. the original call to this function
-int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting, int ceiling) {
-
+//  Bags are resolved by a nested pass over u12 below a ceiling, and the one step core ids by a
+//  final pass: both run on a stack of frames instead of recursive calls.
+int GSWalk::conflict_resolution (const vector<int>& core_ids, GSWalk* s) {
 
     // sanity check: core
-    if (core_ids.size()>0) {
-
-        // Increase hops for sw
-        if (starting) { s->hops+=hops; }
-
-        // NESTING 0 VARS
-        set<int> u12; // the incremental union set over both d12 and d21 and j (includes mutex and node conflict edges)
-        map<int, int> stack_locations;
-        //  ^^^  ^^^    
-        //  to   from
-
-
-        // NESTING 1 VARS (WHILE LOOP THROUGH INSERTION CANDIDATES)
-        map<int, map<int, GSWNode> > ninsert21; 
-        map<int, map<int, GSWEdge> > einsert21; 
-        map<int, map<int, GSWNode> > ninsert12; 
-        map<int, map<int, GSWEdge> > einsert12; 
-        map<int, int> c12_inc;
-
-
-        // NESTING 2 VARS (FOR LOOP THROUGH CORE)
-        set<int> d1;  // the set of edges going out of j in this
-        set<int> d2;  // the set of edges going out of j in s
-        set<int> i12; // the common edges for j (core and node conflict edges)
-        set<int> c12_tmp;
-        set<int> c12; // the common edges for j without the core (exactly the node conflict edges)
-        set<int> d12; // the mutex edges for j (neither core nor node conflict edges)
-        set<int> d21; // 
-        set<int> index_revisit; // index nodes to be revisited, due to out-of-bound indices in to-nodes 
-
-
-        sort(core_ids.begin(), core_ids.end()); 
-        if (nodewalk.size() < core_ids.size()) { cerr << "ERROR! More core ids than nodes." << endl; exit(1); }
-        int border=core_ids.back();
-
-        // prepare basic structure: copy core nodes and connecting edges from this to s, if s is empty
-        bool nodewalk_empty=0;
-        if (s->nodewalk.size() == 0) {
-            nodewalk_empty=1;
-            if (!starting) { 
-                cerr << "Error! Empty nodewalk but not starting." << endl; exit(1); 
-            }
-        }
-
-        if (nodewalk_empty) {
-            #ifdef DEBUG
-            if (fm::die) {
-                cout << "Initializing new SW (" << activating << ")." << endl;
+    if (core_ids.size()==0) return 1;
+
+    // Increase hops for sw
+    s->hops+=hops;
+
+    unsigned int level = 0;
+    if (crframes.size() < 1) crframes.resize(1);
+    crframes[0].core_ids.assign(core_ids.begin(), core_ids.end());
+    crframes[0].ceiling = 0;
+    crframes[0].starting = 1;
+    crframes[0].resuming = 0;
+
+    for (;;) {
+        CRFrame& f = crframes[level];
+        vector<int>& core = f.core_ids;
+        vector<int>& u12 = f.u12;
+        vector<pair<int, int> >& stack_locations = f.stack_locations;
+        const int ceiling = f.ceiling;
+        bool nested = 0;
+
+        if (!f.resuming) {
+            u12.clear();
+            stack_locations.clear();
+
+            sort(core.begin(), core.end());
+            if (nodewalk.size() < core.size()) { cerr << "ERROR! More core ids than nodes." << endl; exit(1); }
+            int border=core.back();
+
+            // prepare basic structure: copy core nodes and connecting edges from this to s, if s is empty
+            bool nodewalk_empty=0;
+            if (s->nodewalk.size() == 0) {
+                nodewalk_empty=1;
+                if (!f.starting) {
+                    cerr << "Error! Empty nodewalk but not starting." << endl; exit(1);
+                }
             }
-            #endif
-        }
 
-        for (vector<int>::iterator index = core_ids.begin(); index!=core_ids.end(); index++) {
-            edgemap::iterator from = edgewalk.find(*index);
-            if (from!=edgewalk.end()) {
-                map<int, GSWEdge>& e1i = from->second;
-                for (map<int, GSWEdge>::iterator to=e1i.begin(); to!=e1i.end(); to++) {
-                    if (to->first <= border) {
-                        map<Tid, int> weightmap_a; 
-                        map<Tid, int> weightmap_i; 
-                        set<InputNodeLabel> inl;
-                        set<InputEdgeLabel> iel;
-                        GSWNode n = { inl };
-                        GSWEdge e = { to->first, iel, weightmap_a, weightmap_i, 0, 0 };
-                        if (nodewalk_empty) s->add_edge(from->first, e, n, 0, &core_ids, &u12);
-                        if (nodewalk_empty || starting) stack_locations[to->first]=from->first;
+            for (vector<int>::iterator index = core.begin(); index!=core.end(); index++) {
+                edgemap::iterator from = edgewalk.find(*index);
+                if (from!=edgewalk.end()) {
+                    map<int, GSWEdge>& e1i = from->second;
+                    for (map<int, GSWEdge>::iterator to=e1i.begin(); to!=e1i.end(); to++) {
+                        if (to->first <= border) {
+                            if (nodewalk_empty) { crempty_edge.to = to->first; s->add_edge(from->first, crempty_edge, crempty_node, 0, &core, &u12); }
+                            if (nodewalk_empty || f.starting) crlocate(stack_locations, to->first, from->first);
+                        }
                     }
                 }
             }
+            if (nodewalk_empty || f.starting) s->stack(this,stack_locations);
+            if (nodewalk_empty) s->activating=activating;
+            stack_locations.clear();
         }
-        if (nodewalk_empty || starting) s->stack(this,stack_locations);
-        if (nodewalk_empty) s->activating=activating;
-        //cout << "init to " << s->activating << endl;
-
-        
-        bool did_ceiling=0;
-        stack_locations.clear();
 
         // Do 'create candidate list and insert lowest edge' while still edges unexpanded for core ids.
+        bool resolved;
         do {
 
+            resolved = f.resuming;
+            f.resuming = 0;
+            if (!resolved) {
+
             #ifdef DEBUG
             if (fm::die) {
                 cout << "-CR begin-" << endl;
                 cout << this ;
                 cout << s ;
                 cout << "core: '";
-                each(core_ids) cout << core_ids[i] << " ";
+                each(core) cout << core[i] << " ";
                 cout << "'" << endl;
             }
             #endif
-        
-            ninsert21.clear();
-            einsert21.clear();
-            ninsert12.clear();
-            einsert12.clear();
-            c12_inc.clear();
-            index_revisit.clear();
 
-            #ifdef DEBUG
-            if (fm::die) {
-                cerr << "U12: '";
-                each_it(u12, set<int>::iterator) cerr << *it << " "; 
-                cerr << "'" <<endl;
+            crinsert21.clear();
+            crinsert12.clear();
+            crc12_inc.clear();
+            crindex_revisit.clear();
+
+            // bitset width: largest node id in the core, u12 and the edges leaving the core
+            int maxid = core.back();
+            if (u12.size()) maxid = maxi(maxid, u12.back());
+            for (unsigned int index = 0; index<core.size(); index++) {
+                edgemap::iterator e1 = edgewalk.find(core[index]);
+                edgemap::iterator e2 = s->edgewalk.find(core[index]);
+                if ( e1!=edgewalk.end() && e1->second.size() ) maxid = maxi(maxid, (--e1->second.end())->first);
+                if ( e2!=s->edgewalk.end() && e2->second.size() ) maxid = maxi(maxid, (--e2->second.end())->first);
             }
-            #endif
+            unsigned int words = maxid / CRWORDBITS + 1;
+            crcore.assign(words, 0);
+            each(core) crcore[core[i] / CRWORDBITS] |= (CRWord) 1 << (core[i] % CRWORDBITS);
+            cru12.assign(words, 0);
+            each(u12) cru12[u12[i] / CRWORDBITS] |= (CRWord) 1 << (u12[i] % CRWORDBITS);
 
             // Gather candidate edges for all core ids!
-            for (int index = 0; index<core_ids.size(); index++) {
+            for (unsigned int index = 0; index<core.size(); index++) {
 
-                int j = core_ids[index];
+                int j = core[index];
 
-                //s->nodewalk[j].stack(nodewalk[j]);
- 
-                d1.clear();  
-                d2.clear();
                 edgemap::iterator e1 = edgewalk.find(j);
                 edgemap::iterator e2 = s->edgewalk.find(j);
-                if ( e1!=edgewalk.end() ) {
-                    // remember tos of this->j
-                    for (map<int, GSWEdge>::iterator it = e1->second.begin(); it!=e1->second.end(); it++) d1.insert(it->first);
-                }
-                if ( e2!=s->edgewalk.end() ) {
-                    // remember tos of s->j
-                    for (map<int, GSWEdge>::iterator it = e2->second.begin(); it!=e2->second.end(); it++) d2.insert(it->first);
-                }
-                #ifdef DEBUG
-                if (fm::die) {
-                    cout << "j: " << j << ", W1: " << e1->second.size() << ", W2: " << e2->second.size() << endl;
-                }
-                #endif
-                // calculate intersection and diff sets of tos
-                i12.clear(); set_intersection(d1.begin(), d1.end(), d2.begin(), d2.end(), std::inserter(i12, i12.end()));                  // intersection (symmetric)
-                c12_tmp.clear(); set_difference(i12.begin(), i12.end(), core_ids.begin(), core_ids.end(), std::inserter(c12_tmp, c12_tmp.end()));
-                c12.clear(); set_difference(c12_tmp.begin(), c12_tmp.end(), u12.begin(), u12.end(), std::inserter(c12, c12.end()));        // intersection \ core_ids (symmetric)
-
-                // REMOVE MORE IDS FROM C12 HERE?????
-                each_it(c12, set<int>::iterator) {
-                    if (*it<core_ids.back()) c12.erase(*it);
-                }
-
-                d12.clear(); set_difference(d1.begin(), d1.end(), i12.begin(), i12.end(), std::inserter(d12, d12.end()));                  // mutex set
-                d21.clear(); set_difference(d2.begin(), d2.end(), i12.begin(), i12.end(), std::inserter(d21, d21.end()));
-        
-                // intersection \ core
-                each_it(c12, set<int>::iterator) {
-                    #ifdef DEBUG
-                    if (fm::die) {
-                        map<int, GSWEdge>& w2j = e2->second;
-                        cout << "C12: " << j << "->" << w2j.find(*it)->first;
-                        cout << " < "; 
-                        set<InputEdgeLabel>& labs = w2j.find(*it)->second.labs;
-                        for (set<InputEdgeLabel>::iterator it2=labs.begin(); it2!=labs.end(); it2++) {
-                            cout << *it2 << " ";
-                        }
-                        cout << ">" << endl;
+                // remember tos of this->j and s->j
+                crd1.assign(words, 0);
+                crd2.assign(words, 0);
+                if ( e1!=edgewalk.end() ) crbits(e1->second, crd1);
+                if ( e2!=s->edgewalk.end() ) crbits(e2->second, crd2);
+
+                for (unsigned int w = 0; w < words; w++) {
+                    CRWord below = crrange(w, 0, ceiling);
+                    CRWord i12 = crd1[w] & crd2[w];                                                   // intersection (symmetric)
+                    CRWord c12 = i12 & ~crcore[w] & ~cru12[w] & crrange(w, core.back(), 0) & below;  // intersection \ core_ids \ u12, above the core
+                    CRWord d12 = crd1[w] & ~i12 & below;                                              // mutex set
+                    CRWord d21 = crd2[w] & ~i12 & below;
+
+                    // intersection \ core
+                    for (; c12; c12 &= c12 - 1) {
+                        int to = w * CRWORDBITS + __builtin_ctzl(c12);
+                        crc12_inc.push_back(make_pair(to, j));
                     }
-                    #endif
-                    if (ceiling==0 || *it<ceiling) c12_inc[*it]=j;
-                }
-        
-                // single edges
-                each_it(d21, set<int>::iterator) {
-                    if (ceiling==0 || *it<ceiling) {
-                        if (*it <= nodewalk.size()) { // only insert in-bound edges
-                            #ifdef DEBUG
-                            if (fm::die) {
-                                map<int, GSWEdge>& w2j = e2->second;
-                                cout << "D21: " << j << "->" << w2j.find(*it)->first;
-                                cout << " < "; 
-                                set<InputEdgeLabel>& labs = w2j.find(*it)->second.labs;
-                                for (set<InputEdgeLabel>::iterator it2=labs.begin(); it2!=labs.end(); it2++) {
-                                    cout << *it2 << " ";
-                                }
-                                cout << ">" << endl;
-                            }
-                            #endif
-                            map<Tid, int> weightmap_a; 
-                            map<Tid, int> weightmap_i; 
-                            set<InputNodeLabel> inl;
-                            set<InputEdgeLabel> iel;
-                            GSWNode n = { inl };
-                            GSWEdge e = { *it, iel, weightmap_a, weightmap_i, 0, 0 };
-                            ninsert21[*it][j]=n;
-                            einsert21[*it][j]=e;
-                        }
-                        else { // remember index for next round
-                            #ifdef DEBUG
-                            if (fm::die) cout << "Node-to-revisit: " << j << endl;
-                            #endif
-                            index_revisit.insert(j);
-                        }
-                    }
-                }
 
-                // nothing inserted, so no recalculation of d12 necessary
-
-                // single edges
-                each_it(d12, set<int>::iterator) {
-                    if (ceiling==0 || *it<ceiling) {
-                        if (*it <= s->nodewalk.size()) {
-                            #ifdef DEBUG
-                            if (fm::die) {
-                                map<int, GSWEdge>& w1j = e1->second;
-                                cout << "D12: " << j << "->" << w1j.find(*it)->first; // needs no check for end() by def of d12
-                                cout << " < ";
-                                set<InputEdgeLabel>& labs = w1j.find(*it)->second.labs;
-                                for (set<InputEdgeLabel>::iterator it2=labs.begin(); it2!=labs.end(); it2++) {
-                                    cout << *it2 << " ";
-                                }
-                                cout << ">" << endl;
-                            }
-                            #endif
-                            map<Tid, int> weightmap_a; 
-                            map<Tid, int> weightmap_i; 
-                            set<InputNodeLabel> inl;
-                            set<InputEdgeLabel> iel;
+                    // single edges
+                    for (; d21; d21 &= d21 - 1) {
+                        int to = w * CRWORDBITS + __builtin_ctzl(d21);
+                        if (to <= (int) nodewalk.size()) crinsert21.push_back(make_pair(to, j)); // only insert in-bound edges
+                        else if (crindex_revisit.empty() || crindex_revisit.back() != j) crindex_revisit.push_back(j); // remember index for next round
+                    }
 
-                            GSWNode n = { inl };
-                            GSWEdge e = { *it, iel, weightmap_a, weightmap_i, 0, 0 };
+                    // nothing inserted, so no recalculation of d12 necessary
 
-                            ninsert12[*it][j]=n;
-                            einsert12[*it][j]=e;
-                        }
-                        else {
-                            #ifdef DEBUG
-                            if (fm::die) cout << "Node-to-revisit: " << j << endl;
-                            #endif
-                            index_revisit.insert(j);
-                        }
+                    // single edges
+                    for (; d12; d12 &= d12 - 1) {
+                        int to = w * CRWORDBITS + __builtin_ctzl(d12);
+                        if (to <= (int) s->nodewalk.size()) crinsert12.push_back(make_pair(to, j));
+                        else if (crindex_revisit.empty() || crindex_revisit.back() != j) crindex_revisit.push_back(j);
                     }
                 }
             } // end for core ids
 
-            
-            map<int, map<int, GSWEdge> >::iterator it21 = einsert21.begin();
-            map<int, map<int, GSWEdge> >::iterator it12 = einsert12.begin();
-            map<int,int>::iterator itc=c12_inc.begin();
+            // lowest to-node first, one edge per pair; a later core id overwrites a conflict to the same node
+            sort(crinsert21.begin(), crinsert21.end()); crinsert21.erase(unique(crinsert21.begin(), crinsert21.end()), crinsert21.end());
+            sort(crinsert12.begin(), crinsert12.end()); crinsert12.erase(unique(crinsert12.begin(), crinsert12.end()), crinsert12.end());
+            stable_sort(crc12_inc.begin(), crc12_inc.end(), crto_less);
+            unsigned int k = 0;
+            for (unsigned int l = 0; l < crc12_inc.size(); l++) {
+                if (l+1 < crc12_inc.size() && crc12_inc[l+1].first == crc12_inc[l].first) continue;
+                crc12_inc[k++] = crc12_inc[l];
+            }
+            crc12_inc.resize(k);
+
+            vector<pair<int, int> >::iterator it21 = crinsert21.begin();
+            vector<pair<int, int> >::iterator it12 = crinsert12.begin();
+            vector<pair<int, int> >::iterator itc = crc12_inc.begin();
 
             // Must recognize 'bags'
             bool do_ceiling=0;
-            int next_to=0; 
-            if (u12.size()) next_to= maxi((*(--u12.end()))+1, core_ids.back()+1);
-            else next_to=core_ids.back()+1;
+            int next_to=0;
+            if (u12.size()) next_to= maxi(u12.back()+1, core.back()+1);
+            else next_to=core.back()+1;
             int c=0;
-            
-            
-                // BUG: NEED TO REPEAT UNTIL NO MORE MATCHING ITC MEMBERS
-                /*
-                // Insert lowest conflict edge!
-            if (itc != c12_inc.end()) {
-                if ( (it21 == einsert21.end()) || (itc->first < it21->first) ) {
-                    if ( (it12 == einsert12.end()) || (itc->first < it12->first) ) {
-                         if (itc->first>next_to) { 
-                             do_ceiling=1; c=itc->first; 
-                             #ifdef DEBUG
-                             cout << "1) NEXT TO < " << itc->first << endl;
-                             #endif
-                         }
-                         else { 
-                             // AM: remember itc->first (to) and itc->second (from)
-                             stack_locations[itc->first]=itc->second;
-                             u12.insert(itc->first);
-                         }
-                    }
-                }
-                if (u12.size()) next_to= maxi((*(--u12.end()))+1, core_ids.back()+1);
-            }
-                */
-                // END: NEED TO REPEAT
-
 
-                // Previous version did not capture the case of multiple itc members being lowest: now while loop.
-                while(  ( itc != c12_inc.end() ) &&
-                        ( (it21 == einsert21.end()) || (itc->first < it21->first) )  &&
-                        ( (it12 == einsert12.end()) || (itc->first < it12->first) ) 
+                // Multiple itc members may be lowest: insert all of them.
+                while(  ( itc != crc12_inc.end() ) &&
+                        ( (it21 == crinsert21.end()) || (itc->first < it21->first) )  &&
+                        ( (it12 == crinsert12.end()) || (itc->first < it12->first) )
                      ) {
-                         if (itc->first>next_to) { 
-                             do_ceiling=1; c=itc->first; 
+                         if (itc->first>next_to) {
+                             do_ceiling=1; c=itc->first;
                              #ifdef DEBUG
                              cout << "1) NEXT TO < " << itc->first << endl;
                              #endif
                              break; // !
                          }
-                         else { 
+                         else {
                              // AM: remember itc->first (to) and itc->second (from)
-                             stack_locations[itc->first]=itc->second;
-                             u12.insert(itc->first);
+                             crlocate(stack_locations, itc->first, itc->second);
+                             crinsert(u12, itc->first);
                              itc++;   // need to step to the next element
                          }
                 }
-                if (u12.size()) next_to= maxi((*(--u12.end()))+1, core_ids.back()+1);
-
-
+                if (u12.size()) next_to= maxi(u12.back()+1, core.back()+1);
 
 
             // Decide which edge to insert, then do it!
-            if ( (it21 != einsert21.end() || it12 != einsert12.end()) && !do_ceiling ) {
+            if ( (it21 != crinsert21.end() || it12 != crinsert12.end()) && !do_ceiling ) {
                 bool insertion_done = 0;
-                if (it21 != einsert21.end()) {
+                if (it21 != crinsert21.end()) {
                     // equal: direction should be 0 (siblingwalk dominance), so we merge from left to right and from top to down (in this order)
-                    if ( (it12 == einsert12.end()) || (it21->first < it12->first) || (it21->first == it12->first) ) { 
-                        if (it21->second.size()>1) { cerr << "Error! More than one edge to the same node (21)." << endl; exit(1); }
+                    if ( (it12 == crinsert12.end()) || (it21->first <= it12->first) ) {
+                        if (it21+1 != crinsert21.end() && (it21+1)->first == it21->first) { cerr << "Error! More than one edge to the same node (21)." << endl; exit(1); }
                         // to node is out of range: re-insert index for next round
-                        if (it21->first > nodewalk.size()) {
+                        if (it21->first > (int) nodewalk.size()) {
                             cerr << "Error! 21: to-node '" << it21->first << "' is out of bound." << endl; exit(1);
                         }
                         else {
@@ -1676,26 +1641,19 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
                                 c=it21->first;
                             }
                             else {
-                                add_edge(
-                                    it21->second.begin()->first,  // begin() jumps to first of always only one element.
-                                    it21->second.begin()->second, 
-                                    ninsert21[it21->first][it21->second.begin()->first],
-                                    1,
-                                    &core_ids,
-                                    &u12
-                                );
-                                // AM: remember it21->first (to) and it21->second.begin()->first (from) for stacking
-                                // stack_locations[it21->first]=it21->second.begin()->first; DO NOT REMEMBER!!! ONLY DIRECTION THIS->S AND CONFLICTS
-                                u12.insert(it21->first);
+                                crempty_edge.to = it21->first;
+                                add_edge(it21->second, crempty_edge, crempty_node, 1, &core, &u12);
+                                // stack_locations are not remembered: ONLY DIRECTION THIS->S AND CONFLICTS
+                                crinsert(u12, it21->first);
                             }
                         }
                         insertion_done = 1;
                     }
                 }
-                if (it12 != einsert12.end()) {
-                    if ( (it21 == einsert21.end()) ||  (it12->first < it21->first) ) {
-                        if (it12->second.size()>1) { cerr << "Error! More than one edge to the same node (12)." << endl; exit(1); }
-                        if (it12->first > s->nodewalk.size()) {
+                if (it12 != crinsert12.end()) {
+                    if ( (it21 == crinsert21.end()) ||  (it12->first < it21->first) ) {
+                        if (it12+1 != crinsert12.end() && (it12+1)->first == it12->first) { cerr << "Error! More than one edge to the same node (12)." << endl; exit(1); }
+                        if (it12->first > (int) s->nodewalk.size()) {
                             cerr << "Error! 12: to-node '" << it12->first << "' is out of bound." << endl; exit(1);
                         }
                         else {
@@ -1707,57 +1665,49 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
                                 c=it12->first;
                             }
                             else {
-                                s->add_edge(
-                                    it12->second.begin()->first, 
-                                    it12->second.begin()->second, 
-                                    ninsert12[it12->first][it12->second.begin()->first],
-                                    1,
-                                    &core_ids,
-                                    &u12
-                                );
-                                // AM: remember it12->first (to) and it12->second.begin()->first (from) for stacking
-                                stack_locations[it12->first]=it12->second.begin()->first;
-                                u12.insert(it12->first);
+                                crempty_edge.to = it12->first;
+                                s->add_edge(it12->second, crempty_edge, crempty_node, 1, &core, &u12);
+                                // AM: remember it12->first (to) and it12->second (from) for stacking
+                                crlocate(stack_locations, it12->first, it12->second);
+                                crinsert(u12, it12->first);
                             }
                         }
                         insertion_done = 1;
                     }
                 }
 
-                if (!insertion_done) { cerr << "Error! No insertion done. " << einsert21.size() << " " << einsert12.size() << endl; exit(1); } 
+                if (!insertion_done) { cerr << "Error! No insertion done. " << crinsert21.size() << " " << crinsert12.size() << endl; exit(1); }
             }
 
-            // bag handling
+            // bag handling: resolve u12 below the ceiling in the frame above, then continue here
             if (do_ceiling) {
                 #ifdef DEBUG
                 if (fm::die) {
                     cout << endl << endl << endl << "STARTING CEILING MODE next_to: '" << next_to << "' c: '" << c << "'" << endl << endl << endl;
                 }
                 #endif
-                conflict_resolution(vector<int> (u12.begin(),u12.end()), s, 0, c);
-                for (int i=next_to; i<c; i++) {
-                    u12.insert(i);
-                }
-                #ifdef DEBUG
-                if (fm::die) {
-                    cout << endl << endl << endl << "ENDING CEILING MODE next_to: '" << next_to << "' c: '" << c << "'" << endl << endl << endl;
+                f.next_to = next_to;
+                f.c = c;
+                if (u12.size()) {
+                    f.resuming = 1;
+                    nested = 1;
+                    break;
                 }
-                #endif
-                do_ceiling=0;
+                resolved = 1; // nothing to resolve
             }
 
+            }
 
-            #ifdef DEBUG
-            else {
-                if (fm::die) {
-                     cout << "Finished CR." << endl;
+            if (resolved) {
+                // bag resolved: nodes up to the ceiling are done
+                for (int i=f.next_to; i<f.c; i++) {
+                    crinsert(u12, i);
                 }
             }
-            #endif
 
             each_it(edgewalk, edgemap::iterator) {
                 for(map<int, GSWEdge>::iterator it2=it->second.begin(); it2!=it->second.end(); it2++) {
-                    if (it2->first >= nodewalk.size()) {
+                    if (it2->first >= (int) nodewalk.size()) {
                         cout << "Error! Nodewalk contains not enough nodes. Index: " << it2->first << ", size: " <<  nodewalk.size() << endl;
                         cout << this ;
                     }
@@ -1765,33 +1715,30 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
             }
             each_it(s->edgewalk, edgemap::iterator) {
                 for(map<int, GSWEdge>::iterator it2=it->second.begin(); it2!=it->second.end(); it2++) {
-                    if (it2->first >= s->nodewalk.size()) {
+                    if (it2->first >= (int) s->nodewalk.size()) {
                         cout << "Error! S-Nodewalk contains not enough nodes. Index: " << it2->first << ", size; " << s->nodewalk.size() << endl;
                         cout << s ;
                     }
                 }
             }
 
-
-        } while (einsert21.size() || einsert12.size() || c12_inc.size()); // Finished all edges for core ids
-        #ifdef DEBUG
-        if (fm::die) {
-             cout << "Left while loop·" << endl;
-        }
-        #endif
-       
-
-        #ifdef DEBUG
-        if (fm::die) {
-            //cout << this ;
-            //cout << s ;
-            cout << "-stack-" << endl;
+        } while (resolved || crinsert21.size() || crinsert12.size() || crc12_inc.size()); // Finished all edges for core ids
+
+        if (nested) {
+            if (crframes.size() < level+2) crframes.resize(level+2); // invalidates f
+            CRFrame& g = crframes[level+1];
+            CRFrame& p = crframes[level];
+            g.core_ids.assign(p.u12.begin(), p.u12.end());
+            g.ceiling = p.c;
+            g.starting = 0;
+            g.resuming = 0;
+            level++;
+            continue;
         }
-        #endif
 
         each_it(edgewalk, edgemap::iterator) {
             for(map<int, GSWEdge>::iterator it2=it->second.begin(); it2!=it->second.end(); it2++) {
-                if (it2->first >= nodewalk.size()) {
+                if (it2->first >= (int) nodewalk.size()) {
                     cout << "Error! Nodewalk contains not enough nodes. Index: " << it2->first << ", size: " <<  nodewalk.size() << endl;
                     cout << this ;
                     exit(1);
@@ -1800,7 +1747,7 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
         }
         each_it(s->edgewalk, edgemap::iterator) {
             for(map<int, GSWEdge>::iterator it2=it->second.begin(); it2!=it->second.end(); it2++) {
-                if (it2->first >= s->nodewalk.size()) {
+                if (it2->first >= (int) s->nodewalk.size()) {
                     cout << "Error! S-Nodewalk contains not enough nodes. Index: " << it2->first << ", size; " << s->nodewalk.size() << endl;
                     cout << s ;
                     exit(1);
@@ -1814,7 +1761,6 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
         // this includes edges inside the core, as well as edges leaving the core
         s->stack(this, stack_locations);
 
-
         #ifdef DEBUG
         if (fm::die) {
             cout << this ;
@@ -1822,33 +1768,27 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
             cout << "-CR end-" << endl;
         }
         #endif
-   
 
-        // calculate one step core ids 
-        #ifdef DEBUG
-        if (fm::die) if (index_revisit.size()) cout << "Revisiting '";
-        #endif
-        each_it(index_revisit, set<int>::iterator) { 
-            #ifdef DEBUG
-            if (fm::die) cout << *it  << " ";
-            #endif
-            u12.insert(*it); 
-        }
-        #ifdef DEBUG
-        if (fm::die) if (index_revisit.size()) cout << "'." << endl;
-        #endif
+        // calculate one step core ids
+        each(crindex_revisit) crinsert(u12, crindex_revisit[i]);
 
-        if (u12.size()) conflict_resolution(vector<int> (u12.begin(),u12.end()), s, 0, ceiling);
+        // the one step core ids replace this frame, a finished frame returns to the frame below
+        if (u12.size()) {
+            core.assign(u12.begin(), u12.end());
+            f.starting = 0;
+            continue;
+        }
+        if (level == 0) break;
+        level--;
+    }
 
-        if (!ceiling) each_it(s->nodewalk, nodevector::iterator) {
-            if (it->labs.size() == 0) {
-                cerr << "Error! S-Labels left to fill." << endl; exit(1);
-            }
+    each_it(s->nodewalk, nodevector::iterator) {
+        if (it->labs.size() == 0) {
+            cerr << "Error! S-Labels left to fill." << endl; exit(1);
         }
-        
-        return 0;
     }
-    return 1;
+
+    return 0;
 }
 
 //! stacks w to this on selected ids
@@ -1856,11 +1796,11 @@ int GSWalk::conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting,
 //  all edges leaving core id nodes
 //  includes edges inside the core, as well as edges leaving the core
 //
-int GSWalk::stack (GSWalk* w, map<int,int> stack_locations) {
+int GSWalk::stack (GSWalk* w, const vector<pair<int,int> >& stack_locations) {
     // sanity check: from ids present in nodewalks
     vector<int> test_ids; for (int i=0;i<nodewalk.size();i++) { test_ids.push_back(i); }
-    vector<int> from_ids; for (map<int,int>::iterator it=stack_locations.begin(); it!=stack_locations.end(); it++) { from_ids.push_back(it->second); } 
-    vector<int> to_ids; for (map<int,int>::iterator it=stack_locations.begin(); it!=stack_locations.end(); it++) { to_ids.push_back(it->first); }
+    vector<int> from_ids; for (vector<pair<int,int> >::const_iterator it=stack_locations.begin(); it!=stack_locations.end(); it++) { from_ids.push_back(it->second); } 
+    vector<int> to_ids; for (vector<pair<int,int> >::const_iterator it=stack_locations.begin(); it!=stack_locations.end(); it++) { to_ids.push_back(it->first); }
 
     remove_dups_vector(from_ids);
     remove_dups_vector(to_ids);
@@ -1890,7 +1830,7 @@ int GSWalk::stack (GSWalk* w, map<int,int> stack_locations) {
 
 
     // edge merging
-    for (map<int,int>::iterator it=stack_locations.begin(); it!=stack_locations.end(); it++) {
+    for (vector<pair<int,int> >::const_iterator it=stack_locations.begin(); it!=stack_locations.end(); it++) {
         int t=it->first;
         int f=it->second;
         edgemap::iterator from = edgewalk.find(f);
@@ -1933,32 +1873,44 @@ int GSWalk::stack (GSWalk* w, map<int,int> stack_locations) {
         }
     }
 
+    return 0;
 }
 
 //! stacks a node n
 //
-int GSWNode::stack (GSWNode n) {
+int GSWNode::stack (const GSWNode& n) {
     labs.insert(n.labs.begin(), n.labs.end());
     return 0;
 }
 
 //! stacks an edge e
 //
-int GSWEdge::stack (GSWEdge e) {
+int GSWEdge::stack (const GSWEdge& e) {
     labs.insert(e.labs.begin(), e.labs.end());
-    for (map<Tid,int>::iterator it=e.a.begin(); it!=e.a.end(); it++) {
-        a[it->first] = a[it->first] + it->second;
-    }
-    for (map<Tid,int>::iterator it=e.i.begin(); it!=e.i.end(); it++) {
-        i[it->first] = i[it->first] + it->second;
-    }
+    add(a, e.a);
+    add(i, e.i);
     discrete_weight = discrete_weight + e.discrete_weight;
     return 0;
 }
 
+void GSWEdge::add (TidWeights& w, const TidWeights& v) {
+    if (!v.size()) return;
+    static TidWeights merged;
+    merged.clear();
+    TidWeights::const_iterator it1 = w.begin(), it2 = v.begin();
+    while (it1 != w.end() && it2 != v.end()) {
+        if (it1->first < it2->first) merged.push_back(*it1++);
+        else if (it2->first < it1->first) merged.push_back(*it2++);
+        else { merged.push_back(make_pair(it1->first, it1->second + it2->second)); it1++; it2++; }
+    }
+    merged.insert(merged.end(), it1, (TidWeights::const_iterator) w.end());
+    merged.insert(merged.end(), it2, v.end());
+    w.swap(merged);
+}
+
 //! Adds a node refinement for edge e and node n.
 //
-void GSWalk::add_edge (int f, GSWEdge e, GSWNode n, bool reorder, vector<int>* core_ids, set<int>* u12) {
+void GSWalk::add_edge (int f, const GSWEdge& e, const GSWNode& n, bool reorder, vector<int>* core_ids, vector<int>* u12) {
 
     #ifdef DEBUG
     if (fm::die) {
@@ -1994,7 +1946,7 @@ void GSWalk::add_edge (int f, GSWEdge e, GSWNode n, bool reorder, vector<int>* c
                 }
             }
             // move edge away
-            if (u12->size()) { val.to= (*(--(u12->end())))+1 ; }
+            if (u12->size()) { val.to= u12->back()+1 ; }
             int coreback=(core_ids->back())+1; if (coreback>val.to) val.to=coreback;
             add_edge(it->first, val, nodewalk[e.to], 1, core_ids, u12 );
             edgewalk[it->first].erase(e.to);
@@ -2098,10 +2050,10 @@ void GSWalk::svd () {
                     double count=0.0;
                     count = count + it2->second.discrete_weight;
                     /*
-                    for (map<Tid, int>::iterator it3=it2->second.a.begin(); it3!=it2->second.a.end(); it3++) {
+                    for (TidWeights::iterator it3=it2->second.a.begin(); it3!=it2->second.a.end(); it3++) {
                         count += it3->second;
                     }
-                    for (map<Tid, int>::iterator it3=it2->second.i.begin(); it3!=it2->second.i.end(); it3++) {
+                    for (TidWeights::iterator it3=it2->second.i.begin(); it3!=it2->second.i.end(); it3++) {
                         count += it3->second;
                     }
                     */
@@ -40,6 +40,9 @@ typedef unsigned int Mark;
 
 class GSWalk;
 
+// weights per tid, sorted by tid
+typedef vector<pair<Tid, int> > TidWeights;
+
 class GraphState {
   public:
 
@@ -85,6 +88,32 @@ class GraphState {
       vector<GSEdge> edges;
     };
 
+    // scratch memory of normalizetree, reused between calls. normalizetree runs nested
+    // at most once (through normalizeSelf), hence one set of buffers per level.
+    struct NormalizeBuffers {
+      vector<int> intbuf;
+      vector<EdgeLabel> labelbuf;
+      vector<char> flagbuf;
+      vector<int*> pointerbuf;
+      vector<CloseTuple> closebuf;
+      unsigned int intwalk, labelwalk, flagwalk, pointerwalk;
+      NormalizeBuffers () : intwalk ( 0 ), labelwalk ( 0 ), flagwalk ( 0 ), pointerwalk ( 0 ) { }
+      void reserve ( unsigned int nrnodes, unsigned int nrclose );
+      int *ints ( unsigned int n ) { intwalk += n; return &intbuf[intwalk - n]; }
+      EdgeLabel *labels ( unsigned int n ) { labelwalk += n; return &labelbuf[labelwalk - n]; }
+      char *flags ( unsigned int n ) { flagwalk += n; return &flagbuf[flagwalk - n]; }
+      int **pointers ( unsigned int n ) { pointerwalk += n; return &pointerbuf[pointerwalk - n]; }
+    };
+    struct NormalizeLevel {
+      int &level;
+      NormalizeLevel ( int &level ) : level ( level ) { level++; }
+      ~NormalizeLevel () { level--; }
+    };
+    NormalizeBuffers normalizebuffers[2];
+    int normalizelevel;
+    vector<int> cyclenodestack, cycleedgestack; // determineCycles
+    vector<char> cycleinstack;
+
     //keep for debugging purposes
     void makeState ( DatabaseTree *databasetree );
     void undoState ();
@@ -111,7 +140,7 @@ class GraphState {
     void reinsertEdge (); // reinserts last edge on the stack
     NodeId lastNode () const { return nodes.size () - 1; }
 
-    void print ( GSWalk* gsw, map<Tid, int> weightmap_a, map<Tid, int> weightmap_i ); 
+    void print ( GSWalk* gsw, const TidWeights& weightmap_a, const TidWeights& weightmap_i ); 
 
     void print ( FILE *f );
     void DfsOut(int cur_n, int from_n);
@@ -130,7 +159,7 @@ struct GSWNode {
     // e.g. v    <6 7>
     set<InputNodeLabel> labs;
 
-    int stack(GSWNode n);
+    int stack(const GSWNode& n);
     friend ostream& operator<< (ostream &out, GSWNode* n);
 };
 
@@ -141,12 +170,13 @@ struct GSWEdge {
     //                                   on this edge
     int to;
     set<InputEdgeLabel> labs;
-    map<Tid, int> a;
-    map<Tid, int> i;
+    TidWeights a;
+    TidWeights i;
     bool deleted;
     int discrete_weight;
 
-    int stack(GSWEdge e);
+    int stack(const GSWEdge& e);
+    static void add (TidWeights& w, const TidWeights& v); // linear merge, adds weights of equal tids
     static bool lt_to (GSWEdge& e1, GSWEdge& e2){
         if (e1.to < e2.to) return 1;
         return 0;
@@ -169,12 +199,13 @@ class GSWalk {
       vector<int> to_nodes_ex; // nodes that were inserted due to high IDs - must be overwritten
       bool activating;
       int hops;
+      unsigned int target; // activity endpoint
       float cutoff;
       bool adj_m_sing;
       int adj_m_rank;
       int adj_m_size;
 
-      int conflict_resolution (vector<int> core_ids, GSWalk* s, bool starting=1, int ceiling=0);
+      int conflict_resolution (const vector<int>& core_ids, GSWalk* s);
         
       static void remove_dups_vector (vector<int>& v) {
           set<int> s;
@@ -189,9 +220,9 @@ class GSWalk {
       }
 
 
-      int stack (GSWalk* single, map<int,int> stack_locations);
+      int stack (GSWalk* single, const vector<pair<int,int> >& stack_locations);
 
-      void add_edge(int f, GSWEdge e, GSWNode n, bool reorder, vector<int>* core_ids, set<int>* u12);
+      void add_edge(int f, const GSWEdge& e, const GSWNode& n, bool reorder, vector<int>* core_ids, vector<int>* u12);
       void svd();
       void up_edge(int i);
       static bool lt_to_map (pair<int, GSWEdge> a, pair<int, GSWEdge> b) {
@@ -200,7 +231,7 @@ class GSWalk {
       }
       friend ostream& operator<< (ostream &out, GSWalk* gsw);
 
-      GSWalk() : activating(0), hops(0), cutoff(0.0), adj_m_sing(0), adj_m_rank(0), adj_m_size(0) {
+      GSWalk() : activating(0), hops(0), target(0), cutoff(0.0), adj_m_sing(0), adj_m_rank(0), adj_m_size(0) {
         to_nodes_ex.clear();
       }
 
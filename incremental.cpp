@@ -0,0 +1,137 @@
+// incremental.cpp
+// © 2009 by Andreas Maunz, andreas@maunz.de, sep 2009
+
+/*
+    This file is part of LibFminer (libfminer).
+
+    LibFminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LibFminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LibFminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incremental.h"
+#include "constraints.h"
+
+namespace fm {
+    extern Database* database;
+    extern ChisqConstraint* chisq;
+    extern bool regression;
+    extern volatile bool cancelled;
+    extern unsigned int gsw_counter;
+}
+
+// Called once the database is reordered. A root must be mined again if a new compound contains
+// its label (support changes). All roots must be mined again if the class sizes (in regression, the
+// activity distribution) changed while the chi-square filter is active (significance of every
+// pattern changes) or the rank order of
+// frequent edge labels changed (enumeration order and thus merging of siblings changes).
+void Incremental::Prepare () {
+    vector<CombinedInputLabel> current;
+    for ( unsigned int i = 0; i < fm::database->edgelabelsindexes.size (); i++ ) {
+        DatabaseEdgeLabel &label = fm::database->edgelabels[fm::database->edgelabelsindexes[i]];
+        current.push_back ( combineInputLabels ( label.inputedgelabel, label.fromnodelabel, label.tonodelabel ) );
+    }
+
+    affected.clear ();
+    all = !updating;
+    if ( updating ) {
+        if ( current != order || ( fm::chisq->active && ( fm::regression || fm::chisq->na != na || fm::chisq->ni != ni ) ) ) all = true;
+        else {
+            for ( Tid t = trees; t < fm::database->trees.size (); t++ ) {
+                DatabaseTree &tree = * ( fm::database->trees[t] );
+                for ( unsigned int i = 0; i < tree.nodes.size (); i++ ) affected.insert ( tree.nodes[i].nodelabel );
+            }
+        }
+        cerr << "Notice: Incremental update with " << fm::database->trees.size () - trees << " new compounds, ";
+        if ( all ) cerr << "all roots affected." << endl;
+        else cerr << affected.size () << " roots affected." << endl;
+    }
+
+    order = current;
+    trees = fm::database->trees.size ();
+    na = fm::chisq->na;
+    ni = fm::chisq->ni;
+}
+
+// graph block without the weights, occurrences and activity data
+static string structure ( const string &block ) {
+    string key, line;
+    istringstream is ( block );
+    while ( getline ( is, line ) )
+        if ( line.find ( "key=\"act\"" ) == string::npos && line.find ( "key=\"hops\"" ) == string::npos &&
+             line.find ( "key=\"weight\"" ) == string::npos && line.find ( "key=\"del\"" ) == string::npos &&
+             line.find ( "key=\"occ_" ) == string::npos ) key.append ( line );
+    return key;
+}
+
+static void write ( const string &block, const char* kind ) {
+    cout << "    <graph id=\"" << ++fm::gsw_counter << "\" edgedefault=\"undirected\">" << endl;
+    cout << "        <data key=\"delta\">" << kind << "</data>" << endl;
+    cout << block << endl;
+}
+
+// redirect the output of a root
+void Incremental::Begin () {
+    capture.str ( "" );
+    capture.clear ();
+    out = cout.rdbuf ( capture.rdbuf () );
+}
+
+void Incremental::End ( NodeLabel root, bool mined ) {
+    cout.rdbuf ( out );
+
+    // split into graph blocks, dropping the id line and the separating blank line
+    vector<string> blocks;
+    string line, block;
+    bool in_graph = false;
+    capture.seekg ( 0 );
+    while ( getline ( capture, line ) ) {
+        if ( in_graph ) {
+            block.append ( line ).append ( "\n" );
+            if ( line.find ( "</graph>" ) != string::npos ) { blocks.push_back ( block ); in_graph = false; }
+        }
+        else if ( line.find ( "<graph id=" ) != string::npos ) { block = ""; in_graph = true; }
+    }
+
+    if ( !updating ) {
+        cout << capture.str ();
+        descriptors[root] = blocks;
+        return;
+    }
+    if ( !mined ) return;
+    if ( fm::cancelled ) {
+        cerr << "Warning! Update of root " << fm::database->nodelabels[root].inputlabel << " was cancelled, no delta written." << endl;
+        return;
+    }
+
+    // unchanged descriptors are not reported
+    multiset<string> previous ( descriptors[root].begin (), descriptors[root].end () );
+    vector<string> current;
+    for ( unsigned int i = 0; i < blocks.size (); i++ ) {
+        multiset<string>::iterator it = previous.find ( blocks[i] );
+        if ( it != previous.end () ) previous.erase ( it );
+        else current.push_back ( blocks[i] );
+    }
+
+    // descriptors with the same nodes, edges and labels are changed, the others added or removed
+    typedef multimap<string, string> blockmap;
+    blockmap removed;
+    each_it ( previous, multiset<string>::iterator ) removed.insert ( make_pair ( structure ( *it ), *it ) );
+    for ( unsigned int i = 0; i < current.size (); i++ ) {
+        blockmap::iterator it = removed.find ( structure ( current[i] ) );
+        if ( it != removed.end () ) { write ( current[i], "changed" ); removed.erase ( it ); }
+        else write ( current[i], "added" );
+    }
+    each_it ( removed, blockmap::iterator ) write ( it->second, "removed" );
+
+    descriptors[root] = blocks;
+}
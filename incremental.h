@@ -0,0 +1,60 @@
+// incremental.h
+// © 2009 by Andreas Maunz, andreas@maunz.de, sep 2009
+
+/*
+    This file is part of LibFminer (libfminer).
+
+    LibFminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LibFminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LibFminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "misc.h"
+#include "database.h"
+
+// State kept between the runs of incremental mining: the input (to rebuild the database
+// after additions) and the descriptors output per root. After an update, only roots whose
+// descriptors can change are mined again, and their output is replaced by a delta
+// (graph data key 'delta': added, removed or changed) against the previous run.
+class Incremental {
+  public:
+    Incremental () : updating(false), trees(0), na(0), ni(0), all(false), out(NULL) {}
+    vector<pair<unsigned int, string> > compounds; // all AddCompound() calls, in order
+    vector<pair<unsigned int, float> > activities; // all AddActivity() calls, in order
+    bool updating; // false in the initial run
+    void Prepare ();
+    bool Affected ( NodeLabel root ) { return all || affected.find ( root ) != affected.end (); }
+    void Begin ();
+    void End ( NodeLabel root, bool mined );
+  private:
+    // state of the previous run
+    map<NodeLabel, vector<string> > descriptors; // graph blocks per root, without the graph id line
+    vector<CombinedInputLabel> order; // frequent edge labels in rank order
+    Tid trees;
+    unsigned int na, ni;
+
+    bool all;
+    set<NodeLabel> affected;
+    stringstream capture;
+    streambuf* out;
+};
+
+#endif
@@ -0,0 +1,94 @@
+// lastmerge.cpp
+// © 2009 by Andreas Maunz, andreas@maunz.de, sep 2009
+
+/*
+    This file is part of LibFminer (libfminer).
+
+    LibFminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    LibFminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with LibFminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Merges the GraphML outputs of sharded runs (Fminer::SetShard) into one document.
+// Shard graph ids have the form <root>.<leg>.<counter>; graphs are ordered by
+// this key, which is the order of an unsharded run, and renumbered from 1.
+// Usage: last-merge shard_0.graphml ... shard_n-1.graphml > merged.graphml
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+using namespace std;
+
+struct ShardGraph {
+    unsigned int root, leg, counter;
+    vector<string> lines; // without the opening <graph> line
+    friend bool operator< ( const ShardGraph &a, const ShardGraph &b ) {
+        return a.root < b.root || ( a.root == b.root && ( a.leg < b.leg || ( a.leg == b.leg && a.counter < b.counter ) ) );
+    }
+};
+
+int main (int argc, char *argv[]) {
+    if (argc < 2) { cerr << "Usage: " << argv[0] << " shard_0.graphml [shard_1.graphml ...] > merged.graphml" << endl; return 1; }
+
+    vector<string> header;
+    vector<ShardGraph> graphs;
+
+    for (int f = 1; f < argc; f++) {
+        ifstream in (argv[f]);
+        if (!in) { cerr << "Error! Could not open '" << argv[f] << "'." << endl; return 1; }
+        vector<string> h;
+        string line;
+        bool in_graph = false, seen_graph = false, closed = false;
+        while (getline (in, line)) {
+            if (in_graph) {
+                graphs.back().lines.push_back(line);
+                if (line.find("</graph>") != string::npos) in_graph = false;
+            }
+            else if (line.find("<graph id=\"") != string::npos) {
+                ShardGraph g; g.root = g.leg = 0;
+                string id = line.substr(line.find("id=\"") + 4);
+                id = id.substr(0, id.find('"'));
+                if (sscanf (id.c_str(), "%u.%u.%u", &g.root, &g.leg, &g.counter) != 3) {
+                    cerr << "Error! Graph id '" << id << "' in '" << argv[f] << "' is not from a sharded run." << endl;
+                    return 1;
+                }
+                graphs.push_back(g);
+                in_graph = seen_graph = true;
+            }
+            else if (line.find("</graphml>") != string::npos) closed = true;
+            else if (!seen_graph) h.push_back(line);
+        }
+        if (in_graph || !closed) cerr << "Warning! '" << argv[f] << "' is incomplete (interrupted shard?)." << endl;
+        if (in_graph) graphs.pop_back();
+        // blank lines before the first graph are not part of the header
+        while (h.size() && !h.back().size()) h.pop_back();
+        if (f == 1) header = h;
+        else {
+            if (header != h) { cerr << "Error! Header of '" << argv[f] << "' differs from '" << argv[1] << "'." << endl; return 1; }
+        }
+    }
+
+    stable_sort (graphs.begin(), graphs.end());
+
+    for (unsigned int i = 0; i < header.size(); i++) cout << header[i] << endl;
+    for (unsigned int i = 0; i < graphs.size(); i++) {
+        cout << "    <graph id=\"" << i+1 << "\" edgedefault=\"undirected\">" << endl;
+        for (unsigned int j = 0; j < graphs[i].lines.size(); j++) cout << graphs[i].lines[j] << endl;
+        cout << endl;
+    }
+    cout << "</graphml>" << endl;
+    return 0;
+}
@@ -30,20 +30,29 @@ namespace fm {
     extern LegOccurrences* legoccurrences;
     extern unsigned int minfreq;
     extern vector<LegOccurrences> candidatelegsoccurrences; 
+    extern vector<EdgeLabel> candidatelegstouched;
+    extern vector<bool> candidatelegsmarked;
+    extern vector<Tid> candidatelegslastself;
+    extern unsigned int embedding_min_size;
+    extern vector<int> embeddingnumber;
+    extern vector<unsigned int> embeddingstamp;
+    extern unsigned int embeddingclock;
     extern vector<vector< CloseLegOccurrences> > candidatecloselegsoccs;
-    extern vector<bool> candidatecloselegsoccsused;
-    extern bool closelegsoccsused;
+    extern int type;
 }
 
 void initLegStatics () {
   fm::candidatecloselegsoccs.reserve ( 200 ); // should be larger than the largest structure that contains a cycle
   fm::candidatelegsoccurrences.resize ( fm::database->frequentEdgeLabelSize () );
+  fm::candidatelegsmarked.assign ( fm::database->frequentEdgeLabelSize (), false );
+  fm::candidatelegslastself.resize ( fm::database->frequentEdgeLabelSize () );
+  fm::candidatelegstouched.clear ();
 }
 
 
 /*
 ostream &operator<< ( ostream &stream, LegOccurrence &occ ) {
-  stream << "[" << occ.tid << "(" << fm::database->trees[occ.tid]->activity  << ")" << "," << occ.occurrenceid << "," << occ.tonodeid << "," << occ.fromnodeid << "]";
+  stream << "[" << occ.tid << "(" << fm::database->trees[occ.tid]->activity[0]  << ")" << "," << occ.occurrenceid << "," << occ.tonodeid << "," << occ.fromnodeid << "]";
   return stream;
 }
 */
@@ -201,25 +210,57 @@ inline int nocycle ( DatabaseTreePtr tree, DatabaseTreeNode &node, NodeId tonode
   return 0;
 }
 
-void candidateCloseLegsAllocate ( int number, int maxnumber ) {
-  if ( !fm::closelegsoccsused ) {
-    int oldsize = fm::candidatecloselegsoccs.size ();
-    fm::candidatecloselegsoccs.resize ( maxnumber );
-    for ( int k = oldsize; k < (int) fm::candidatecloselegsoccs.size (); k++ ) {
-      fm::candidatecloselegsoccs[k].resize ( fm::database->frequentEdgeLabelSize () );
+// For large patterns, the nodes of the occurrence being extended are mapped to their pattern node
+// numbers, such that nocycle is a lookup instead of a walk along the parents. The map of a tree node
+// is valid while its stamp equals the clock. Consecutive occurrences with the same parent occurrence
+// only differ in their last node, so only that node is remapped between them.
+class Embedding {
+  public:
+    Embedding ( LegOccurrences &legoccurrencesdata ) : legoccurrencesdata ( legoccurrencesdata ), valid ( false ) {
+      active = fm::embedding_min_size && legoccurrencesdata.number >= (int) fm::embedding_min_size;
+    }
+    bool active;
+    void set ( OccurrenceId occurrenceid );
+    int nocycle ( DatabaseTreePtr tree, DatabaseTreeNode &node, NodeId tonode ) {
+      if ( !tree->nodes[tonode].incycle || !node.incycle )
+        return 0;
+      return fm::embeddingstamp[tonode] == fm::embeddingclock ? fm::embeddingnumber[tonode] : 0;
     }
-    fm::candidatecloselegsoccsused.resize ( 0 );
-    fm::candidatecloselegsoccsused.resize ( maxnumber, false );
-    fm::closelegsoccsused = true;
+  private:
+    LegOccurrences &legoccurrencesdata;
+    bool valid;
+    OccurrenceId parentid;
+    NodeId last;
+};
+
+void Embedding::set ( OccurrenceId occurrenceid ) {
+  LegOccurrence &legocc = legoccurrencesdata.elements[occurrenceid];
+  if ( valid && legocc.occurrenceid == parentid ) {
+    fm::embeddingstamp[last] = 0;
   }
-  if ( !fm::candidatecloselegsoccsused[number] ) {
-    fm::candidatecloselegsoccsused[number] = true;
-    vector<CloseLegOccurrences> &candidateedgelabeloccs = fm::candidatecloselegsoccs[number];
-    for ( int k = 0; k < (int) candidateedgelabeloccs.size (); k++ ) {
-      candidateedgelabeloccs[k].elements.resize ( 0 );
-      candidateedgelabeloccs[k].frequency = 0;
+  else {
+    if ( ++fm::embeddingclock == 0 ) {
+      fill ( fm::embeddingstamp.begin (), fm::embeddingstamp.end (), 0 );
+      fm::embeddingclock = 1;
+    }
+    unsigned int size = fm::database->trees[legocc.tid]->nodes.size ();
+    if ( fm::embeddingstamp.size () < size ) {
+      fm::embeddingstamp.resize ( size, 0 );
+      fm::embeddingnumber.resize ( size );
     }
+    OccurrenceId id = legocc.occurrenceid;
+    for ( LegOccurrencesPtr walk = legoccurrencesdata.parent; walk; walk = walk->parent ) {
+      LegOccurrence &parentocc = walk->elements[id];
+      fm::embeddingstamp[parentocc.tonodeid] = fm::embeddingclock;
+      fm::embeddingnumber[parentocc.tonodeid] = walk->number;
+      id = parentocc.occurrenceid;
+    }
+    parentid = legocc.occurrenceid;
+    valid = true;
   }
+  last = legocc.tonodeid;
+  fm::embeddingstamp[last] = fm::embeddingclock;
+  fm::embeddingnumber[last] = legoccurrencesdata.number;
 }
 
 
@@ -227,6 +268,33 @@ void candidateCloseLegsAllocate ( int number, int maxnumber ) {
 
 
 
+
+// Only the candidate legs filled by the last extend are reset, such that the cost does not depend
+// on the number of frequent edge labels. Untouched entries are always empty with frequency 0.
+static void candidateLegsReset () {
+  for ( int k = 0; k < (int) fm::candidatelegstouched.size (); k++ ) {
+    EdgeLabel edgelabel = fm::candidatelegstouched[k];
+    fm::candidatelegsoccurrences[edgelabel].elements.resize ( 0 );
+    fm::candidatelegsoccurrences[edgelabel].frequency = 0;
+    fm::candidatelegsmarked[edgelabel] = false;
+  }
+  fm::candidatelegstouched.resize ( 0 );
+}
+
+static inline LegOccurrences &candidateLeg ( EdgeLabel edgelabel, LegOccurrences &legoccurrencesdata ) {
+  LegOccurrences &candidatelegoccs = fm::candidatelegsoccurrences[edgelabel];
+  if ( !fm::candidatelegsmarked[edgelabel] ) {
+    fm::candidatelegsmarked[edgelabel] = true;
+    fm::candidatelegstouched.push_back ( edgelabel );
+    candidatelegoccs.parent = &legoccurrencesdata;
+    candidatelegoccs.number = legoccurrencesdata.number + 1;
+    candidatelegoccs.maxdegree = 0;
+    candidatelegoccs.selfjoin = 0;
+    fm::candidatelegslastself[edgelabel] = NOTID;
+  }
+  return candidatelegoccs;
+}
+
 void extend ( LegOccurrences &legoccurrencesdata ) {
   // we're trying hard to avoid repeated destructor/constructor calls for complex types like vectors.
   // better reuse previously allocated memory, if possible!
@@ -234,37 +302,26 @@ void extend ( LegOccurrences &legoccurrencesdata ) {
   
 
   vector<LegOccurrence> &legoccurrences = legoccurrencesdata.elements;   ///////////////////////////////////////AM : BUG!!!
+  vector<Tid> &lastself = fm::candidatelegslastself;
 
-
-
-  Tid lastself[fm::candidatelegsoccurrences.size ()];
-
-  for ( int i = 0; i < (int) fm::candidatelegsoccurrences.size (); i++ ) {
-    fm::candidatelegsoccurrences[i].elements.resize ( 0 );
-    //fm::candidatelegsoccurrences[i].elements.reserve ( legoccurrences.size () ); // increases memory usage, but also speed!
-    fm::candidatelegsoccurrences[i].parent = &legoccurrencesdata;
-    fm::candidatelegsoccurrences[i].number = legoccurrencesdata.number + 1;
-    fm::candidatelegsoccurrences[i].maxdegree = 0;
-    fm::candidatelegsoccurrences[i].frequency = 0;
-    fm::candidatelegsoccurrences[i].selfjoin = 0;
-    lastself[i] = NOTID;
-  }
-
-  fm::closelegsoccsused = false; // we are lazy with the initialization of close leg arrays, as we may not need them at all in
-                             // many cases
+  candidateLegsReset ();
+  candidateCloseLegsReset ();
+  Embedding embedding ( legoccurrencesdata );
 
   for ( OccurrenceId i = 0; i < legoccurrences.size (); i++ ) {
     LegOccurrence &legocc = legoccurrences[i];
     DatabaseTreePtr tree = fm::database->trees[legocc.tid];
     DatabaseTreeNode &node = tree->nodes[legocc.tonodeid];
+    if ( embedding.active && node.incycle )
+      embedding.set ( i );
     for ( int j = 0; j < node.edges.size (); j++ ) {
       if ( node.edges[j].tonode != legocc.fromnodeid ) {
       	EdgeLabel edgelabel = node.edges[j].edgelabel;
 
-        int number = nocycle ( tree, node, node.edges[j].tonode, i, &legoccurrencesdata );
+        int number = embedding.active ? embedding.nocycle ( tree, node, node.edges[j].tonode ) : nocycle ( tree, node, node.edges[j].tonode, i, &legoccurrencesdata );
 
         if ( number == 0 ) {
-          vector<LegOccurrence> &candidatelegsoccs = fm::candidatelegsoccurrences[edgelabel].elements;
+          vector<LegOccurrence> &candidatelegsoccs = candidateLeg ( edgelabel, legoccurrencesdata ).elements;
           if ( candidatelegsoccs.empty () )  fm::candidatelegsoccurrences[edgelabel].frequency++;
           else {
 
@@ -283,17 +340,19 @@ void extend ( LegOccurrences &legoccurrencesdata ) {
         }
 
         else if ( number - 1 != fm::graphstate->nodes.back().edges[0].tonode ) {
-            candidateCloseLegsAllocate ( number, legoccurrencesdata.number + 1 );
-            vector<CloseLegOccurrence> &candidatelegsoccs = fm::candidatecloselegsoccs[number][edgelabel].elements;
+            setmax ( candidateLeg ( edgelabel, legoccurrencesdata ).maxdegree, fm::database->trees[legocc.tid]->nodes[node.edges[j].tonode].edges.size () );
+            if ( fm::type == 1 ) continue; // paths only: cycle closing legs are never expanded
+            CloseLegOccurrences &candidateoccs = candidateCloseLegs ( number, edgelabel );
+            vector<CloseLegOccurrence> &candidatelegsoccs = candidateoccs.elements;
             if ( !candidatelegsoccs.size () || candidatelegsoccs.back ().tid != legocc.tid )
-	            fm::candidatecloselegsoccs[number][edgelabel].frequency++;
+	            candidateoccs.frequency++;
             candidatelegsoccs.push_back ( CloseLegOccurrence ( legocc.tid, i ) );
-            setmax ( fm::candidatelegsoccurrences[edgelabel].maxdegree, fm::database->trees[legocc.tid]->nodes[node.edges[j].tonode].edges.size () );
         }
 
       }
     }
   }
+  sort ( fm::candidatelegstouched.begin (), fm::candidatelegstouched.end () );
 }
 
 
@@ -312,42 +371,31 @@ void extend ( LegOccurrences &legoccurrencesdata, EdgeLabel minlabel, EdgeLabel
 
 
   vector<LegOccurrence> &legoccurrences = legoccurrencesdata.elements;  ///////////////////////////////////////AM : BUG!!!
+  vector<Tid> &lastself = fm::candidatelegslastself;
 
-
-
-
-  int lastself[fm::candidatelegsoccurrences.size ()];
-  
-  for ( int i = 0; i < (int) fm::candidatelegsoccurrences.size (); i++ ) {
-    fm::candidatelegsoccurrences[i].elements.resize ( 0 );
-    fm::candidatelegsoccurrences[i].parent = &legoccurrencesdata;
-    fm::candidatelegsoccurrences[i].number = legoccurrencesdata.number + 1;
-    fm::candidatelegsoccurrences[i].maxdegree = 0;
-    fm::candidatelegsoccurrences[i].selfjoin = 0;
-    lastself[i] = NOTID;
-    fm::candidatelegsoccurrences[i].frequency = 0;
-  }
-
-  fm::closelegsoccsused = false; // we are lazy with the initialization of close leg arrays, as we may not need them at all in
-                             // many cases
+  candidateLegsReset ();
+  candidateCloseLegsReset ();
+  Embedding embedding ( legoccurrencesdata );
   for ( OccurrenceId i = 0; i < legoccurrences.size (); i++ ) {
     LegOccurrence &legocc = legoccurrences[i];
     DatabaseTreePtr tree = fm::database->trees[legocc.tid];
     DatabaseTreeNode &node = tree->nodes[legocc.tonodeid];
+    if ( embedding.active && node.incycle )
+      embedding.set ( i );
     for ( int j = 0; j < node.edges.size (); j++ ) {
       if ( node.edges[j].tonode != legocc.fromnodeid ) {
 	EdgeLabel edgelabel = node.edges[j].edgelabel;
-        int number = nocycle ( tree, node, node.edges[j].tonode, i, &legoccurrencesdata );
+        int number = embedding.active ? embedding.nocycle ( tree, node, node.edges[j].tonode ) : nocycle ( tree, node, node.edges[j].tonode, i, &legoccurrencesdata );
         if ( number == 0 ) {
 	  if ( edgelabel >= minlabel && edgelabel != neglect ) {
-            vector<LegOccurrence> &candidatelegsoccs = fm::candidatelegsoccurrences[edgelabel].elements;
+            vector<LegOccurrence> &candidatelegsoccs = candidateLeg ( edgelabel, legoccurrencesdata ).elements;
             if ( candidatelegsoccs.empty () )
   	      fm::candidatelegsoccurrences[edgelabel].frequency++;
 	    else {
 	      if ( candidatelegsoccs.back ().tid != legocc.tid )
   	        fm::candidatelegsoccurrences[edgelabel].frequency++;
 	      if ( candidatelegsoccs.back ().occurrenceid == i &&
-                lastself[edgelabel] != (int) legocc.tid ) {
+                lastself[edgelabel] != legocc.tid ) {
                 lastself[edgelabel] = legocc.tid;
                 fm::candidatelegsoccurrences[edgelabel].selfjoin++;
               }
@@ -357,17 +405,17 @@ void extend ( LegOccurrences &legoccurrencesdata, EdgeLabel minlabel, EdgeLabel
 	  }
         }
         else if ( number - 1 != fm::graphstate->nodes.back().edges[0].tonode ) {
-          candidateCloseLegsAllocate ( number, legoccurrencesdata.number + 1 );
-
-          vector<CloseLegOccurrence> &candidatelegsoccs = fm::candidatecloselegsoccs[number][edgelabel].elements;
+          CloseLegOccurrences &candidateoccs = candidateCloseLegs ( number, edgelabel );
+          vector<CloseLegOccurrence> &candidatelegsoccs = candidateoccs.elements;
           if ( !candidatelegsoccs.size () || candidatelegsoccs.back ().tid != legocc.tid )
-	    fm::candidatecloselegsoccs[number][edgelabel].frequency++;
+	    candidateoccs.frequency++;
           candidatelegsoccs.push_back ( CloseLegOccurrence ( legocc.tid, i ) );
-          setmax ( fm::candidatelegsoccurrences[edgelabel].maxdegree, fm::database->trees[legocc.tid]->nodes[node.edges[j].tonode].edges.size () );
+          setmax ( candidateLeg ( edgelabel, legoccurrencesdata ).maxdegree, fm::database->trees[legocc.tid]->nodes[node.edges[j].tonode].edges.size () );
         }
       }
     }
   }
+  sort ( fm::candidatelegstouched.begin (), fm::candidatelegstouched.end () );
 }
 
 /*
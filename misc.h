@@ -23,14 +23,22 @@
 #define MISC_H
 #include <vector>
 #include <stdio.h>
+#include <time.h>
 #include <iostream>
 #include <sstream>
 #include <set>
 
 using namespace std;
 
+// Labels are 8 bit for cache density. Build with -DWIDE_LABELS (see Makefile) for 16 bit labels
+// if the data has more than 254 node labels or combined edge labels.
+#ifdef WIDE_LABELS
+typedef unsigned short EdgeLabel; // combined node-edge label of the input file.
+typedef unsigned short NodeLabel;
+#else
 typedef unsigned char EdgeLabel; // combined node-edge label of the input file.
 typedef unsigned char NodeLabel;
+#endif
 typedef unsigned short NodeId;
 typedef unsigned int Depth; // unsigned int is more efficient than short, but requires more memory...
 typedef unsigned int Tid;
@@ -25,6 +25,7 @@
 #include "graphstate.h"
 #include <iomanip>
 #include "misc.h"
+#include "checkpoint.h"
 
 namespace fm {
     extern unsigned int minfreq;
@@ -39,14 +40,160 @@ namespace fm {
     extern bool gsp_out;
     extern bool die;
     extern bool do_last;
+    extern bool closed_only;
+    extern bool edge_occurrences;
+    extern volatile bool cancelled;
+    extern unsigned int shard;
+    extern unsigned int shards;
+    extern bool shard_legs;
+    extern unsigned int shard_leg;
+    extern bool shard_balance;
+    extern vector<unsigned int> shard_plan;
+    extern time_t deadline;
 
     extern Database* database;
     extern ChisqConstraint* chisq;
+    extern vector<ChisqConstraint*> endpoints;
     extern vector<string>* result;
     extern Statistics* statistics;
     extern GraphState* graphstate;
+    extern Checkpoint* checkpoint;
 
     extern vector<LegOccurrences> candidatelegsoccurrences; 
+    extern vector<EdgeLabel> candidatelegstouched;
+}
+
+// checked at each refinement; interrupted expansions return their siblingwalk as is
+bool mining_interrupted () {
+  if ( !fm::cancelled && fm::deadline && time ( NULL ) >= fm::deadline ) {
+    cerr << "Notice: Time limit exceeded, returning partial result." << endl;
+    fm::cancelled = true;
+  }
+  return fm::cancelled;
+}
+
+// LAST merging, once per activity endpoint (the siblingwalk and topdown of endpoint t are at index t)
+vector<GSWalk*> last_walks () {
+  vector<GSWalk*> walks;
+  for (unsigned int t = 0; t < fm::endpoints.size(); t++) {
+    walks.push_back ( new GSWalk() );
+    walks.back()->target = t;
+  }
+  return walks;
+}
+
+// outputs siblingwalk (if it merged anything) and restarts it
+void last_flush ( GSWalk*& siblingwalk, unsigned int target ) {
+    if (siblingwalk->hops>0) {
+        if (siblingwalk->hops>1) {
+            siblingwalk->svd();
+        }
+        cout << siblingwalk;
+    }
+    delete siblingwalk;
+    siblingwalk = new GSWalk();
+    siblingwalk->target = target;
+}
+
+// !STOP: the walk of the current pattern is merged to siblingwalk. If the pattern is not significant or
+// changes the class, siblingwalk is output and restarted first. Returns whether it is not significant.
+// A significant pattern that is not closed is left out after that: a refinement in the same compounds
+// (with the same significance and class) is merged instead.
+bool last_pattern ( ChisqConstraint* c, GSWalk*& siblingwalk, const vector<int>& core_ids, int& gsw_size, bool closed, const char* site ) {
+    GSWalk* gsw = new GSWalk();
+    bool nsign=1;
+
+    if (c->active) {
+        TidWeights weightmap_a, weightmap_i;
+        if (fm::edge_occurrences) {
+            each_it(c->fa_set, set<Tid>::iterator) { weightmap_a.push_back(make_pair((*it),1)); }
+            each_it(c->fi_set, set<Tid>::iterator) { weightmap_i.push_back(make_pair((*it),1)); }
+        }
+        fm::graphstate->print(gsw, weightmap_a, weightmap_i);
+        gsw->activating=c->activating;
+        if (c->p >= c->sig) {
+            nsign=0;
+        }
+    }
+    gsw_size=gsw->nodewalk.size();
+
+    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Already nodes marked as available "<<site<<".1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
+
+    if (nsign || gsw->activating!=siblingwalk->activating) last_flush (siblingwalk, c->target);
+    if (!nsign && !closed) { delete gsw; return nsign; }
+    if (!nsign && ((gsw->activating==siblingwalk->activating) || !siblingwalk->edgewalk.size())) {
+        #ifdef DEBUG
+        if (fm::die) cout << "CR gsw " << site << endl;
+        #endif
+        gsw->conflict_resolution(core_ids, siblingwalk);
+    }
+
+    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Still nodes marked as available "<<site<<".1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
+
+    delete gsw;
+    return nsign;
+}
+
+// UB-PRUNING: the current pattern is refined if some endpoint may have significant refinements. The
+// other endpoints are collected in 'pruned' and marked as such until the refinements are done.
+bool last_refine ( vector<ChisqConstraint*>& pruned ) {
+    if (fm::endpoints.size() == 1) return ( !fm::do_pruning || (fm::chisq->u >= fm::chisq->sig) );
+    bool refine = false;
+    for (unsigned int t = 0; t < fm::endpoints.size(); t++) {
+        ChisqConstraint* c = fm::endpoints[t];
+        if (c->pruned) continue;
+        if (!fm::do_pruning || (c->u >= c->sig)) refine = true;
+        else pruned.push_back(c);
+    }
+    if (refine) for (unsigned int t = 0; t < pruned.size(); t++) pruned[t]->pruned = true;
+    else pruned.clear();
+    return refine;
+}
+
+// closed patterns only: the refinements of the current pattern must be known before it is merged, which
+// is needed only if it is significant for some endpoint
+bool last_significant () {
+    if (!fm::closed_only || !fm::chisq->active) return false;
+    for (unsigned int t = 0; t < fm::endpoints.size(); t++)
+        if (!fm::endpoints[t]->pruned && fm::endpoints[t]->p >= fm::endpoints[t]->sig) return true;
+    return false;
+}
+
+// STOP: OUTPUT TOPDOWN, ELSE: MERGE TO SIBLINGWALK
+void last_topdown ( GSWalk* topdown, GSWalk* siblingwalk, bool nsign, const vector<int>& core_ids, const char* site ) {
+    if (topdown == NULL || !topdown->edgewalk.size()) return;
+
+    #ifdef DEBUG
+    if (fm::die) {
+        cout << "TOPDOWN BEGIN " << core_ids.size() << endl;
+        cout << topdown ;
+        cout << "--result--" << endl;
+        cout << siblingwalk ;
+    }
+    #endif
+
+    if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Already nodes marked as available " << site << ".2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
+    if (nsign || siblingwalk->activating!=topdown->activating) {
+        if (topdown->hops>0) { 
+            if (topdown->hops>1) { 
+                topdown->svd();
+            }
+            cout << topdown; 
+        }
+    }
+    else {
+        topdown->conflict_resolution(core_ids, siblingwalk);
+    }
+    if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Still nodes marked as available " << site << ".2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
+
+    #ifdef DEBUG
+    if (fm::die) {
+        cout << "TOPDOWN END " << core_ids.size() << endl;
+        cout << topdown ;
+        cout << "--result--" << endl;
+        cout << siblingwalk ;
+    }
+    #endif
 }
 
 // for every database node...
@@ -68,7 +215,7 @@ Path::Path ( NodeLabel startnodelabel ) {
                                                                                                     //  ^^^^^^^^^ is frequency rank!
     sort ( frequentedgelabels.begin (), frequentedgelabels.end () );                                // restores the rank order
     
-    Tid lastself[frequentedgelabels.size ()];
+    vector<Tid> lastself ( frequentedgelabels.size (), NOTID );
     vector<EdgeLabel> edgelabelorder ( fm::database->edgelabelsindexes.size () );
     EdgeLabel j = 0;
 
@@ -101,8 +248,6 @@ Path::Path ( NodeLabel startnodelabel ) {
             leg->tuple.nodelabel = databaseedgelabel.fromnodelabel;
         }
 
-        lastself[i] = NOTID;
-
    }
     
     // ... OCCURRENCES DESCRIBES LOCATION IN TREE (2)
@@ -128,16 +273,19 @@ Path::Path ( NodeLabel startnodelabel ) {
   
 }
 
+// In a paths only run (type 1) legs inside the path (tree growth) and close legs (cycles) are
+// never expanded, so they are not built.
 Path::Path ( Path &parentpath, unsigned int legindex ) {
   PathLeg &leg = (*parentpath.legs[legindex]);
   int positionshift;
+  bool trees = fm::type > 1;
   
   // fill in normalisation information, it seems a lot of code, but in fact it's just a walk through the edge/nodelabels arrays.
 
   nodelabels.resize ( parentpath.nodelabels.size () + 1 );
   edgelabels.resize ( parentpath.edgelabels.size () + 1 );
 
-  addCloseExtensions ( closelegs, parentpath.closelegs, leg.occurrences );
+  if ( trees ) addCloseExtensions ( closelegs, parentpath.closelegs, leg.occurrences );
 
   if ( parentpath.nodelabels.size () == 1 ) {
     totalsymmetry = parentpath.nodelabels[0] - leg.tuple.nodelabel;
@@ -200,7 +348,8 @@ Path::Path ( Path &parentpath, unsigned int legindex ) {
 
     // build OccurrenceLists
     extend ( leg.occurrences );
-    for (unsigned int i = 0; i < fm::candidatelegsoccurrences.size (); i++ ) {
+    for (unsigned int k = 0; k < fm::candidatelegstouched.size (); k++ ) {
+      EdgeLabel i = fm::candidatelegstouched[k];
       if ( fm::candidatelegsoccurrences[i].frequency >= fm::minfreq ) {
         PathLegPtr leg2 = new PathLeg;
         legs.push_back ( leg2 );
@@ -271,6 +420,7 @@ Path::Path ( Path &parentpath, unsigned int legindex ) {
   LegOccurrencesPtr legoccurrencesptr;
   for ( ; i < legindex; i++ ) {
     PathLeg &leg2 = (*parentpath.legs[i]);
+    if ( !trees && !isEnd ( leg2.tuple.depth + positionshift ) ) continue;
 
     if ( (legoccurrencesptr = join ( leg.occurrences, leg2.tuple.connectingnode, leg2.occurrences )) ) { // JOIN OCCURRENCES
       PathLegPtr leg3 = new PathLeg;
@@ -283,7 +433,7 @@ Path::Path ( Path &parentpath, unsigned int legindex ) {
     }
   }
 
-  if ( (legoccurrencesptr = join ( leg.occurrences )) ) {
+  if ( ( trees || isEnd ( leg.tuple.depth + positionshift ) ) && (legoccurrencesptr = join ( leg.occurrences )) ) {
     PathLegPtr leg3 = new PathLeg;
     legs.push_back ( leg3 );
     leg3->tuple.connectingnode = leg.tuple.connectingnode;
@@ -295,6 +445,7 @@ Path::Path ( Path &parentpath, unsigned int legindex ) {
 
   for ( i++; i < parentpath.legs.size (); i++ ) {
     PathLeg &leg2 = (*parentpath.legs[i]);
+    if ( !trees && !isEnd ( leg2.tuple.depth + positionshift ) ) continue;
     if ( (legoccurrencesptr = join ( leg.occurrences, leg2.tuple.connectingnode, leg2.occurrences )) ) {
       PathLegPtr leg3 = new PathLeg;
       legs.push_back ( leg3 );
@@ -307,12 +458,13 @@ Path::Path ( Path &parentpath, unsigned int legindex ) {
   }
 
   if ( positionshift ) {
-    addCloseExtensions ( closelegs, leg.occurrences.number ); // stored separately
+    if ( trees ) addCloseExtensions ( closelegs, leg.occurrences.number ); // stored separately
     return;
   }
 
   extend ( leg.occurrences );
-  for ( unsigned int i = 0; i < fm::candidatelegsoccurrences.size (); i++ ) {
+  for ( unsigned int k = 0; k < fm::candidatelegstouched.size (); k++ ) {
+    EdgeLabel i = fm::candidatelegstouched[k];
     if ( fm::candidatelegsoccurrences[i].frequency >= fm::minfreq ) {
       PathLegPtr leg2 = new PathLeg;
       legs.push_back ( leg2 );
@@ -328,7 +480,13 @@ Path::Path ( Path &parentpath, unsigned int legindex ) {
     }
   }
 
-  addCloseExtensions ( closelegs, leg.occurrences.number );
+  if ( trees ) addCloseExtensions ( closelegs, leg.occurrences.number );
+}
+
+bool Path::closed ( Frequency frequency ) {
+  for ( unsigned int i = 0; i < legs.size (); i++ )
+    if ( legs[i]->occurrences.frequency == frequency ) return false;
+  return true;
 }
 
 Path::~Path () {
@@ -424,7 +582,7 @@ bool Path::is_normal ( EdgeLabel edgelabel ) {
 
 
 
-GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
+vector<GSWalk*> Path::expand2 (pair<float,string> max, const int parent_size) {
 
   assert(parent_size>0);
 
@@ -438,7 +596,7 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
   
   if ( fm::statistics->patternsize == ((1<<(sizeof(NodeId)*8))-1) ) {
     fm::statistics->patternsize--;
-    return new GSWalk();
+    return vector<GSWalk*> ();
   }
 
   vector<unsigned int> forwpathlegs; forwpathlegs.clear();
@@ -484,9 +642,9 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
   }
  
 
-  // horizontal view: conflict_resolution will merge into siblingwalk
+  // horizontal view: conflict_resolution will merge into siblingwalk (one per endpoint)
   // NOTE: siblingwalk is intended to 'carry' the growing meta pattern
-  GSWalk* siblingwalk = new GSWalk();
+  vector<GSWalk*> siblingwalk = last_walks ();
 
   vector<int> core_ids; 
   for (int j=0; j<parent_size; j++) core_ids.push_back(j);
@@ -494,20 +652,20 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
   
   // Grow Path forw
   for (unsigned int j=0; j<forwpathlegs.size() ; j++ ) {
+    if (mining_interrupted ()) break;
     unsigned int index = forwpathlegs[j];
 
-    GSWalk* gsw = new GSWalk();
-    GSWalk* topdown = NULL;
-
-    bool nsign=1;
+    vector<GSWalk*> topdown;
+    vector<bool> nsign (fm::endpoints.size(), 1);
+    vector<ChisqConstraint*> pruned;
+    int gsw_size = 0;
 
     #ifdef DEBUG
     int diehard = 0;
     #endif
 
     // Calculate chisq
-    if (fm::chisq->active) fm::chisq->Calc(legs[index]->occurrences.elements);
-    float cur_chisq=fm::chisq->p;
+    if (fm::chisq->active) ChisqConstraint::Calc(fm::endpoints, legs[index]->occurrences.elements);
           
     // GRAPHSTATE AND OUTPUT
     fm::graphstate->insertNode ( legs[index]->tuple.connectingnode, legs[index]->tuple.edgelabel, legs[index]->occurrences.maxdegree );
@@ -524,95 +682,35 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
     fm::die=1;
     #endif
    
-    if (fm::chisq->active) {
-        map<Tid, int> weightmap_a; each_it(fm::chisq->fa_set, set<Tid>::iterator) { weightmap_a.insert(make_pair((*it),1)); }
-        map<Tid, int> weightmap_i; each_it(fm::chisq->fi_set, set<Tid>::iterator) { weightmap_i.insert(make_pair((*it),1)); }
-        fm::graphstate->print(gsw, weightmap_a, weightmap_i);
-        gsw->activating=fm::chisq->activating;
-        if (cur_chisq >= fm::chisq->sig) {
-            nsign=0;
-        }
+    // CLOSED: REFINE FIRST
+    Path* path = NULL;
+    bool closed = true;
+    if ( ( fm::refine_singles || (legs[index]->occurrences.frequency>1) ) && last_significant () ) {
+        path = new Path ( *this, index );
+        closed = path->closed ( legs[index]->occurrences.frequency );
     }
-    const int gsw_size=gsw->nodewalk.size();
 
     // !STOP: MERGE TO SIBLINGWALK
-    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Already nodes marked as available 2.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
-
-    if (nsign || gsw->activating!=siblingwalk->activating) {
-          if (siblingwalk->hops>0) {
-              if (siblingwalk->hops>1) {
-                  siblingwalk->svd();
-              }
-              cout << siblingwalk;
-          }
-          delete siblingwalk;
-          siblingwalk = new GSWalk();
-    }
-    if (!nsign && ((gsw->activating==siblingwalk->activating) || !siblingwalk->edgewalk.size())) {
-        #ifdef DEBUG
-        if (fm::die) cout << "CR gsw 1" << endl;
-        #endif
-        int res=gsw->conflict_resolution(core_ids, siblingwalk);
-    }
-
-    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Still nodes marked as available 2.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
+    for (unsigned int t = 0; t < fm::endpoints.size(); t++)
+        if (!fm::endpoints[t]->pruned) nsign[t] = last_pattern (fm::endpoints[t], siblingwalk[t], core_ids, gsw_size, closed, "2");
 
     // RECURSE
-    if ( ( !fm::do_pruning || (fm::chisq->u >= fm::chisq->sig) ) &&
-         (  fm::refine_singles || (legs[index]->occurrences.frequency>1) )
+    if ( (  fm::refine_singles || (legs[index]->occurrences.frequency>1) ) &&
+         last_refine (pruned)
        ) {   // UB-PRUNING
-            Path path ( *this, index );
-            if (max.first<fm::chisq->p) { fm::updated = true; topdown = path.expand2 ( pair<float, string>(fm::chisq->p, fm::graphstate->to_s(legs[index]->occurrences.frequency)), gsw_size); }
-            else topdown = path.expand2 (max,  gsw_size);
+            if (!path) path = new Path ( *this, index );
+            if (max.first<fm::chisq->p) { fm::updated = true; topdown = path->expand2 ( pair<float, string>(fm::chisq->p, fm::graphstate->to_s(legs[index]->occurrences.frequency)), gsw_size); }
+            else topdown = path->expand2 (max,  gsw_size);
+            for (unsigned int t = 0; t < pruned.size(); t++) pruned[t]->pruned = false;
     }
+    delete path;
 
     // merge to siblingwalk
-    if (topdown != NULL) {
-         if (topdown->edgewalk.size()) {
-
-              #ifdef DEBUG
-              if (fm::die) {
-                  cout << "TOPDOWN BEGIN " << core_ids.size() << endl;
-                  cout << topdown ;
-                  cout << "--result--" << endl;
-                  cout << siblingwalk ;
-              }
-              #endif
-
-              if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Already nodes marked as available 2.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-              // STOP: OUTPUT TOPDOWN
-              if (nsign || siblingwalk->activating!=topdown->activating) {
-                  #ifdef DEBUG
-                  if (fm::die) cout << "STOP CRITERIUM at CHI " << cur_chisq << endl;
-                  #endif
-                  if (topdown->hops>0) { 
-                      if (topdown->hops>1) { 
-                          topdown->svd();
-                      }
-                      cout << topdown; 
-                  }
-              }
-              // ELSE: MERGE TO SIBLINGWALK
-              else {
-                  int res=topdown->conflict_resolution(core_ids, siblingwalk);
-              }
-              if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Still nodes marked as available 2.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; each_it(topdown->to_nodes_ex, vector<int>::iterator) cout << *it << " "; cout << endl;  exit(1); }
-
-              #ifdef DEBUG
-              if (fm::die) {
-                  cout << "TOPDOWN END " << core_ids.size() << endl;
-                  cout << topdown ;
-                  cout << "--result--" << endl;
-                  cout << siblingwalk ;
-              }
-              #endif
-         }
-    }
+    for (unsigned int t = 0; t < topdown.size(); t++) last_topdown (topdown[t], siblingwalk[t], nsign[t], core_ids, "2");
 
     fm::graphstate->deleteNode ();
 
-    delete topdown;
-    delete gsw;
+    for (unsigned int t = 0; t < topdown.size(); t++) delete topdown[t];
 
     #ifdef DEBUG
     if (diehard==1) { 
@@ -628,16 +726,16 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
 
   // Grow Path backw
   for (unsigned int j=0; j<backwpathlegs.size() ; j++ ) {
+    if (mining_interrupted ()) break;
     unsigned int index = backwpathlegs[j];
     
-    GSWalk* gsw = new GSWalk();
-    GSWalk* topdown = NULL;
-
-    bool nsign=1;
+    vector<GSWalk*> topdown;
+    vector<bool> nsign (fm::endpoints.size(), 1);
+    vector<ChisqConstraint*> pruned;
+    int gsw_size = 0;
 
     // Calculate chisq
-    if (fm::chisq->active) fm::chisq->Calc(legs[index]->occurrences.elements);
-    float cur_chisq = fm::chisq->p;
+    if (fm::chisq->active) ChisqConstraint::Calc(fm::endpoints, legs[index]->occurrences.elements);
 
     // GRAPHSTATE AND OUTPUT
     fm::graphstate->insertNode ( legs[index]->tuple.connectingnode, legs[index]->tuple.edgelabel, legs[index]->occurrences.maxdegree );
@@ -645,97 +743,35 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
     fm::graphstate->print(legs[index]->occurrences.frequency);
     #endif
 
-    if (fm::chisq->active) {
-        map<Tid, int> weightmap_a; each_it(fm::chisq->fa_set, set<Tid>::iterator) { weightmap_a.insert(make_pair((*it),1)); }
-        map<Tid, int> weightmap_i; each_it(fm::chisq->fi_set, set<Tid>::iterator) { weightmap_i.insert(make_pair((*it),1)); }
-        fm::graphstate->print(gsw, weightmap_a, weightmap_i);
-        gsw->activating=fm::chisq->activating;
-        if (cur_chisq >= fm::chisq->sig) {
-            nsign=0;
-        }
+    // CLOSED: REFINE FIRST
+    Path* path = NULL;
+    bool closed = true;
+    if ( ( fm::refine_singles || (legs[index]->occurrences.frequency>1) ) && last_significant () ) {
+        path = new Path ( *this, index );
+        closed = path->closed ( legs[index]->occurrences.frequency );
     }
-    const int gsw_size=gsw->nodewalk.size();
 
     // !STOP: MERGE TO SIBLINGWALK
-    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Already nodes marked as available 3.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
-
-    if (nsign || gsw->activating!=siblingwalk->activating) {
-          if (siblingwalk->hops>0) {
-              if (siblingwalk->hops>1) {
-                  siblingwalk->svd();
-              }
-              cout << siblingwalk;
-          }
-          delete siblingwalk;
-          siblingwalk = new GSWalk();
-    }
-    if (!nsign && ((gsw->activating==siblingwalk->activating) || !siblingwalk->edgewalk.size())) {
-        #ifdef DEBUG
-        if (fm::die) cout << "CR gsw 2" << endl;
-        #endif
-        int res=gsw->conflict_resolution(core_ids, siblingwalk);
-    }
-
-    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Still nodes marked as available 3.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
- 
+    for (unsigned int t = 0; t < fm::endpoints.size(); t++)
+        if (!fm::endpoints[t]->pruned) nsign[t] = last_pattern (fm::endpoints[t], siblingwalk[t], core_ids, gsw_size, closed, "3");
 
     // RECURSE
-    if ( ( !fm::do_pruning || (fm::chisq->u >= fm::chisq->sig) ) &&
-         (  fm::refine_singles || (legs[index]->occurrences.frequency>1) )
+    if ( (  fm::refine_singles || (legs[index]->occurrences.frequency>1) ) &&
+         last_refine (pruned)
        ) {   // UB-PRUNING
-            Path path ( *this, index );
-            if (max.first<fm::chisq->p) { fm::updated = true; topdown = path.expand2 ( pair<float, string>(fm::chisq->p, fm::graphstate->to_s(legs[index]->occurrences.frequency)), gsw_size); }
-            else topdown = path.expand2 (max, gsw_size);
+            if (!path) path = new Path ( *this, index );
+            if (max.first<fm::chisq->p) { fm::updated = true; topdown = path->expand2 ( pair<float, string>(fm::chisq->p, fm::graphstate->to_s(legs[index]->occurrences.frequency)), gsw_size); }
+            else topdown = path->expand2 (max, gsw_size);
+            for (unsigned int t = 0; t < pruned.size(); t++) pruned[t]->pruned = false;
     }
+    delete path;
 
     // merge to siblingwalk
-    if (topdown != NULL) {
-         if (topdown->edgewalk.size()) {
-
-              #ifdef DEBUG
-              if (fm::die) {
-                  cout << "TOPDOWN BEGIN " << core_ids.size() << endl;
-                  cout << topdown ;
-                  cout << "--result--" << endl;
-                  cout << siblingwalk ;
-              }
-              #endif
-
-              if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Already nodes marked as available 3.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-              // STOP: OUTPUT TOPDOWN
-              if (nsign || siblingwalk->activating!=topdown->activating) {
-                  #ifdef DEBUG
-                  if (fm::die) cout << "STOP CRITERIUM at CHI " << cur_chisq << endl;
-                  #endif
-                  if (topdown->hops>0) { 
-                      if (topdown->hops>1) { 
-                          topdown->svd();
-                      }
-                      cout << topdown; 
-                  }
-              }
-              // ELSE: MERGE TO SIBLINGWALK
-              else {
-                  int res=topdown->conflict_resolution(core_ids, siblingwalk); 
-              }
-              if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Still nodes marked as available 3.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-
-              #ifdef DEBUG
-              if (fm::die) {
-                  cout << "TOPDOWN END " << core_ids.size() << endl;
-                  cout << topdown ;
-                  cout << "--result--" << endl;
-                  cout << siblingwalk ;
-              }
-              #endif
-         }
-    }
+    for (unsigned int t = 0; t < topdown.size(); t++) last_topdown (topdown[t], siblingwalk[t], nsign[t], core_ids, "3");
 
-   
     fm::graphstate->deleteNode ();
 
-    delete topdown;
-    delete gsw;
+    for (unsigned int t = 0; t < topdown.size(); t++) delete topdown[t];
 
   }
 
@@ -747,6 +783,7 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
   }
 
   for ( unsigned int i = 0; i < legs.size (); i++ ) {
+    if (mining_interrupted ()) break;
     PathTuple &tuple = legs[i]->tuple;
     if ( tuple.depth != nodelabels.size () - 1 ) {
 
@@ -758,12 +795,12 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
       fm::type > 1 ) {
 
           // new current pattern
-          GSWalk* gsw = new GSWalk();
-          GSWalk* topdown = NULL;
-
-          bool nsign=1;
+          vector<GSWalk*> topdown;
+          vector<bool> nsign (fm::endpoints.size(), 1);
+          vector<ChisqConstraint*> pruned;
+          int gsw_size = 0;
 
-          if (fm::chisq->active) fm::chisq->Calc(legs[i]->occurrences.elements);
+          if (fm::chisq->active) ChisqConstraint::Calc(fm::endpoints, legs[i]->occurrences.elements);
           float cur_chisq = fm::chisq->p;
 
           fm::graphstate->insertNode ( legs[i]->tuple.connectingnode, legs[i]->tuple.edgelabel, legs[i]->occurrences.maxdegree );
@@ -778,95 +815,33 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
           //if (s.find("C-C(-O-C-N-O)(=C-C)")!=string::npos) { fm::die=1; diehard=1; }
           #endif
 
-          if (fm::chisq->active) {
-              map<Tid, int> weightmap_a; each_it(fm::chisq->fa_set, set<Tid>::iterator) { weightmap_a.insert(make_pair((*it),1)); }
-              map<Tid, int> weightmap_i; each_it(fm::chisq->fi_set, set<Tid>::iterator) { weightmap_i.insert(make_pair((*it),1)); }
-              fm::graphstate->print(gsw, weightmap_a, weightmap_i);
-              gsw->activating=fm::chisq->activating;
-              if (cur_chisq >= fm::chisq->sig) {
-                  nsign=0;
-              }
+          // CLOSED: REFINE FIRST
+          PatternTree* tree = NULL;
+          bool closed = true;
+          if ( ( fm::refine_singles || (legs[i]->occurrences.frequency>1) ) && last_significant () ) {
+              tree = new PatternTree ( *this, i );
+              closed = tree->closed ( legs[i]->occurrences.frequency );
           }
-          const int gsw_size=gsw->nodewalk.size();
 
           // !STOP: MERGE TO SIBLINGWALK
-          if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Already nodes marked as available 4.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
-
-          if (nsign || gsw->activating!=siblingwalk->activating) {
-                if (siblingwalk->hops>0) {
-                    if (siblingwalk->hops>1) {
-                        siblingwalk->svd();
-                    }
-                    cout << siblingwalk;
-                }
-                delete siblingwalk;
-                siblingwalk = new GSWalk();
-          }
-          if (!nsign && ((gsw->activating==siblingwalk->activating) || !siblingwalk->edgewalk.size())) {
-              #ifdef DEBUG
-              if (fm::die) cout << "CR gsw 3" << endl;
-              #endif
-              int res=gsw->conflict_resolution(core_ids, siblingwalk);
-          }
+          for (unsigned int t = 0; t < fm::endpoints.size(); t++)
+              if (!fm::endpoints[t]->pruned) nsign[t] = last_pattern (fm::endpoints[t], siblingwalk[t], core_ids, gsw_size, closed, "4");
 
-
-          if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Still nodes marked as available 4.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
-
-          if ( ( !fm::do_pruning ||  (fm::chisq->u >= fm::chisq->sig ) ) &&
-               (  fm::refine_singles || (legs[i]->occurrences.frequency>1) )
+          if ( (  fm::refine_singles || (legs[i]->occurrences.frequency>1) ) &&
+               last_refine (pruned)
              ) {
-              PatternTree tree ( *this, i );
-              if (max.first<cur_chisq) { fm::updated = true; topdown = tree.expand ( pair<float, string>(cur_chisq, fm::graphstate->to_s(legs[i]->occurrences.frequency)), gsw_size); }
-              else topdown = tree.expand (max, gsw_size);
+              if (!tree) tree = new PatternTree ( *this, i );
+              if (max.first<cur_chisq) { fm::updated = true; topdown = tree->expand ( pair<float, string>(cur_chisq, fm::graphstate->to_s(legs[i]->occurrences.frequency)), gsw_size); }
+              else topdown = tree->expand (max, gsw_size);
+              for (unsigned int t = 0; t < pruned.size(); t++) pruned[t]->pruned = false;
           }
+          delete tree;
 
           // merge to siblingwalk
-          if (topdown != NULL) {
-               if (topdown->edgewalk.size()) {
-
-                    #ifdef DEBUG
-                    if (fm::die) {
-                        cout << "TOPDOWN BEGIN " << core_ids.size() << endl;
-                        cout << topdown ;
-                        cout << "--result--" << endl;
-                        cout << siblingwalk ;
-                    }
-                    #endif
-
-                    if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Already nodes marked as available 4.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-                    // STOP: OUTPUT TOPDOWN
-                    if (nsign || siblingwalk->activating!=topdown->activating) {
-                        #ifdef DEBUG
-                        if (fm::die) cout << "STOP CRITERIUM at CHI " << cur_chisq << endl;
-                        #endif
-                        if (topdown->hops>0) { 
-                            if (topdown->hops>1) { 
-                                topdown->svd();
-                            }
-                            cout << topdown; 
-                        }
-                    }
-                    // ELSE: MERGE TO SIBLINGWALK
-                    else {
-                        int res=topdown->conflict_resolution(core_ids, siblingwalk);
-                    }
-                    if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Still nodes marked as available 4.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-
-                    #ifdef DEBUG
-                    if (fm::die) {
-                        cout << "TOPDOWN END " << core_ids.size() << endl;
-                        cout << topdown;
-                        cout << "--result--" << endl;
-                        cout << siblingwalk ;
-                    }
-                    #endif
-               }
-          }
-
+          for (unsigned int t = 0; t < topdown.size(); t++) last_topdown (topdown[t], siblingwalk[t], nsign[t], core_ids, "4");
 
 	      fm::graphstate->deleteNode ();
-          delete topdown;
-          delete gsw;
+          for (unsigned int t = 0; t < topdown.size(); t++) delete topdown[t];
           #ifdef DEBUG
           if (diehard==1) { 
              cerr << "DYING HARD! " << legs.size() << endl;
@@ -901,24 +876,39 @@ GSWalk* Path::expand2 (pair<float,string> max, const int parent_size) {
 void Path::expand () {
 
   //fm::die=1;
-  // horizontal view: conflict_resolution will merge into siblingwalk
+  // horizontal view: conflict_resolution will merge into siblingwalk (one per endpoint)
   // NOTE: siblingwalk is intended to 'carry' the growing meta pattern
-  GSWalk* siblingwalk = new GSWalk();
+  vector<GSWalk*> siblingwalk = last_walks ();
   vector<int> core_ids; core_ids.push_back(0); core_ids.push_back(1);
   int legcnt=0;
 
-  for ( unsigned int i = 0; i < legs.size (); i++ ) {
+  // legs completed by an interrupted run are skipped
+  unsigned int legs_done = ( fm::checkpoint ? fm::checkpoint->LegsDone ( nodelabels[0] ) : 0 );
 
-    GSWalk* gsw = new GSWalk(); 
-    GSWalk* topdown = NULL;
+  // root legs are numbered across all roots when sharding on root-plus-first-edge pairs
+  unsigned int leg_offset = 0;
+  for ( unsigned int r = 0; r < nodelabels[0]; r++ ) leg_offset += fm::database->nodelabels[r].frequentedgelabels.size ();
 
-    bool nsign=1;
+  for ( unsigned int i = legs_done; i < legs.size (); i++ ) {
+
+    if (mining_interrupted ()) break;
+
+    fm::shard_leg = i;
+    // the shard plan has one entry per leg only when sharding on legs; the legs before and after a leg of
+    // another shard are not adjacent siblings, so nothing is merged across it
+    if (fm::shard_legs && ( fm::shard_balance ? fm::shard_plan[leg_offset + i] : (leg_offset + i) % fm::shards ) != fm::shard) {
+        for (unsigned int t = 0; t < siblingwalk.size(); t++) last_flush (siblingwalk[t], t);
+        continue;
+    }
+
+    vector<GSWalk*> topdown;
+    vector<bool> nsign (fm::endpoints.size(), 1);
+    int gsw_size = 0;
 
     PathTuple &tuple = legs[i]->tuple;
     if ( tuple.nodelabel >= nodelabels[0] ) {
         
-      if (fm::chisq->active) fm::chisq->Calc(legs[i]->occurrences.elements);
-      float cur_chisq = fm::chisq->p;
+      if (fm::chisq->active) ChisqConstraint::Calc(fm::endpoints, legs[i]->occurrences.elements);
 
       // GRAPHSTATE AND OUTPUT
       fm::graphstate->insertNode ( tuple.connectingnode, tuple.edgelabel, legs[i]->occurrences.maxdegree );
@@ -926,99 +916,38 @@ void Path::expand () {
       fm::graphstate->print(legs[i]->occurrences.frequency);
       #endif
 
-      if (fm::chisq->active) {
-          map<Tid, int> weightmap_a; each_it(fm::chisq->fa_set, set<Tid>::iterator) { weightmap_a.insert(make_pair((*it),1)); }
-          map<Tid, int> weightmap_i; each_it(fm::chisq->fi_set, set<Tid>::iterator) { weightmap_i.insert(make_pair((*it),1)); }
-          fm::graphstate->print(gsw, weightmap_a, weightmap_i);
-          gsw->activating=fm::chisq->activating;
-          if (cur_chisq >= fm::chisq->sig) {
-              nsign=0;
-          }
-      }
-      const int gsw_size=gsw->nodewalk.size();
+      // CLOSED: REFINE FIRST
+      Path path (*this, i);
+      bool closed = ( !last_significant () || path.closed ( legs[i]->occurrences.frequency ) );
 
       // !STOP: MERGE TO SIBLINGWALK
-      if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Already nodes marked as available 1.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
-
-      if (nsign || gsw->activating!=siblingwalk->activating) {
-            if (siblingwalk->hops>0) {
-                if (siblingwalk->hops>1) {
-                    siblingwalk->svd();
-                }
-                cout << siblingwalk;
-            }
-            delete siblingwalk;
-            siblingwalk = new GSWalk();
-      }
-      if (!nsign && ((gsw->activating==siblingwalk->activating) || !siblingwalk->edgewalk.size())) {
-          #ifdef DEBUG
-          if (fm::die) cout << "CR gsw 4" << endl;
-          #endif
-          int res=gsw->conflict_resolution(core_ids, siblingwalk);
-      }
-
-      if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Still nodes marked as available 1.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
-
+      for (unsigned int t = 0; t < fm::endpoints.size(); t++)
+          nsign[t] = last_pattern (fm::endpoints[t], siblingwalk[t], core_ids, gsw_size, closed, "1");
 
       // RECURSE
-      Path path (*this, i);
       fm::updated = true;
 
       topdown = path.expand2 (pair<float, string>(fm::chisq->p, fm::graphstate->to_s(legs[i]->occurrences.frequency)), gsw_size);
 
       // merge to siblingwalk
-      if (topdown != NULL) {
-           if (topdown->edgewalk.size()) {
-
-                #ifdef DEBUG
-                if (fm::die) {
-                    cout << "TOPDOWN BEGIN " << core_ids.size() << endl;
-                    cout << topdown;
-                    cout << "--result--" << endl;
-                    cout << siblingwalk ;
-                }
-                #endif
-
-                if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Already nodes marked as available 1.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-                // STOP: OUTPUT TOPDOWN
-                if (nsign || siblingwalk->activating!=topdown->activating) {
-                    #ifdef DEBUG
-                    if (fm::die) cout << "STOP CRITERIUM at CHI " << cur_chisq << endl;
-                    #endif
-                    if (topdown->hops>0) { 
-                        if (topdown->hops>1) { 
-                            topdown->svd();
-                        }
-                        cout << topdown; 
-                    }
-                }
-                // ELSE: MERGE TO SIBLINGWALK
-                else {
-                    int res=topdown->conflict_resolution(core_ids, siblingwalk); 
-                }
-                if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Still nodes marked as available 1.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-
-                #ifdef DEBUG
-                if (fm::die) {
-                    cout << "TOPDOWN END " << core_ids.size() << endl;
-                    cout << topdown ;
-                    cout << "--result--" << endl;
-                    cout << siblingwalk ;
-                }
-                #endif
-           }
-      }
+      for (unsigned int t = 0; t < topdown.size(); t++) last_topdown (topdown[t], siblingwalk[t], nsign[t], core_ids, "1");
 
       fm::graphstate->deleteNode ();
 
     }
 
-    delete gsw;    
-    delete topdown;
+    for (unsigned int t = 0; t < topdown.size(); t++) delete topdown[t];
+
+    // safe to resume after this leg only if nothing is carried over to the next one
+    bool carried = false;
+    for (unsigned int t = 0; t < siblingwalk.size(); t++)
+        if ( siblingwalk[t]->nodewalk.size() || siblingwalk[t]->edgewalk.size() || siblingwalk[t]->activating || siblingwalk[t]->hops ) carried = true;
+    if ( fm::checkpoint && !fm::cancelled && !carried )
+        fm::checkpoint->Legs ( nodelabels[0], i+1 );
 
   }
   fm::graphstate->deleteStartNode ();
-  delete siblingwalk;
+  for (unsigned int t = 0; t < siblingwalk.size(); t++) delete siblingwalk[t];
 
 //  cerr << "backtracking p" << endl;
 }
@@ -1028,6 +957,43 @@ void Path::expand () {
 
 
 
+// Cost estimate for every root leg (0 for legs not expanded by expand ()): occurrences of the leg plus
+// the occurrences of its frequent refinements times their number. Only every n-th leg is refined so
+// that at most 'samples' legs are (0: all), the others are extrapolated by the mean ratio to their
+// occurrences. Like expand (), this consumes the start node.
+vector<float> Path::costs ( unsigned int samples ) {
+  vector<float> result ( legs.size (), 0.0 );
+  vector<unsigned int> eligible;
+  for ( unsigned int i = 0; i < legs.size (); i++ )
+    if ( legs[i]->tuple.nodelabel >= nodelabels[0] ) eligible.push_back ( i );
+
+  if ( eligible.size () ) {
+    unsigned int step = ( samples && eligible.size () > samples ? eligible.size () / samples : 1 );
+    float ratio = 0.0;
+    unsigned int sampled = 0;
+    for ( unsigned int k = 0; k < eligible.size (); k += step ) {
+      unsigned int i = eligible[k];
+      fm::graphstate->insertNode ( legs[i]->tuple.connectingnode, legs[i]->tuple.edgelabel, legs[i]->occurrences.maxdegree );
+      Path path ( *this, i );
+      float occs = 0.0;
+      for ( unsigned int l = 0; l < path.legs.size (); l++ ) occs += path.legs[l]->occurrences.elements.size ();
+      fm::graphstate->deleteNode ();
+      result[i] = legs[i]->occurrences.elements.size () + occs * path.legs.size ();
+      ratio += result[i] / legs[i]->occurrences.elements.size ();
+      sampled++;
+    }
+    ratio /= sampled;
+    for ( unsigned int k = 0; k < eligible.size (); k++ ) {
+      unsigned int i = eligible[k];
+      if ( k % step ) result[i] = ratio * legs[i]->occurrences.elements.size ();
+    }
+  }
+
+  fm::graphstate->deleteStartNode ();
+  return result;
+}
+
+
 ostream &operator<< ( ostream &stream, Path &path ) {
   stream << /* database->nodelabels[ */ (int) path.nodelabels[0] /* ].inputlabel; */ << " ";
   for ( unsigned int i = 0; i < path.edgelabels.size (); i++ ) {
@@ -48,16 +48,29 @@ struct PathLeg {
 
 typedef PathLeg *PathLegPtr;
 
+bool mining_interrupted (); // true once mining was cancelled or the time limit is exceeded
+
+// LAST merging per activity endpoint, shared by Path and PatternTree (see path.cpp)
+vector<GSWalk*> last_walks ();
+void last_flush ( GSWalk*& siblingwalk, unsigned int target );
+bool last_pattern ( ChisqConstraint* c, GSWalk*& siblingwalk, const vector<int>& core_ids, int& gsw_size, bool closed, const char* site );
+bool last_refine ( vector<ChisqConstraint*>& pruned );
+bool last_significant ();
+void last_topdown ( GSWalk* topdown, GSWalk* siblingwalk, bool nsign, const vector<int>& core_ids, const char* site );
+
 class Path {
   public:
     Path ( NodeLabel startnodelabel );
     ~Path ();
     void expand ();
+    vector<float> costs ( unsigned int samples );
   private:
     friend class PatternTree;
     bool is_normal ( EdgeLabel edgelabel ); // ADDED
-    GSWalk* expand2 (pair<float, string> max, const int parent_size);
+    vector<GSWalk*> expand2 (pair<float, string> max, const int parent_size); // walks per endpoint
     Path ( Path &parentpath, unsigned int legindex );
+    bool isEnd ( Depth depth ) { return depth == 0 || depth == nodelabels.size () - 1; } // leg extends the path
+    bool closed ( Frequency frequency ); // no leg (refinement) has this support
     vector<PathLegPtr> legs; // pointers used to avoid copy-constructor during a resize of the vector
     vector<CloseLegPtr> closelegs;
     vector<NodeLabel> nodelabels;
@@ -34,15 +34,23 @@ namespace fm {
     extern bool gsp_out;
     extern int die;
     extern bool do_last;
+    extern bool closed_only;
+    extern bool edge_occurrences;
+    extern unsigned int gsw_counter;
+    extern unsigned int shards;
+    extern unsigned int shard_root;
+    extern unsigned int shard_leg;
 
     extern Database* database;
     extern ChisqConstraint* chisq;
+    extern vector<ChisqConstraint*> endpoints;
     extern vector<string>* result;
     extern Statistics* statistics;
     extern GraphState* graphstate;
     extern LegOccurrences* legoccurrences;
 
     extern vector<LegOccurrences> candidatelegsoccurrences; 
+    extern vector<EdgeLabel> candidatelegstouched;
 }
 
 int maxsize = ( 1 << ( sizeof(NodeId)*8 ) ) - 1; // safe default for the largest allowed pattern
@@ -62,7 +70,7 @@ void PatternTree::addExtensionLegs ( Tuple &tuple, LegOccurrences &legoccurrence
   if ( legoccurrences.maxdegree == 1 )
     return;
   if ( tuple.depth == maxdepth ) {
-    extend ( legoccurrences, MAXEDGELABEL, (unsigned char) NONODE );
+    extend ( legoccurrences, MAXEDGELABEL, NOEDGELABEL );
     addCloseExtensions ( closelegs, legoccurrences.number );
     return;
   }
@@ -71,7 +79,7 @@ void PatternTree::addExtensionLegs ( Tuple &tuple, LegOccurrences &legoccurrence
   if ( nextprefixindex != NONEXTPREFIX ) {
     if ( treetuples[nextprefixindex].depth <= tuple.depth ) {
       // heuristic saving
-      extend ( legoccurrences, MAXEDGELABEL, (unsigned char) NONODE );
+      extend ( legoccurrences, MAXEDGELABEL, NOEDGELABEL );
       addCloseExtensions ( closelegs, legoccurrences.number );
       return;
     }
@@ -84,7 +92,7 @@ void PatternTree::addExtensionLegs ( Tuple &tuple, LegOccurrences &legoccurrence
   if ( tuple.depth == maxdepth - 1 ) {
     if ( rootpathrelations.back () > 0 ) {
       // heuristic saving
-      extend ( legoccurrences, MAXEDGELABEL, (unsigned char) NONODE );
+      extend ( legoccurrences, MAXEDGELABEL, NOEDGELABEL );
       addCloseExtensions ( closelegs, legoccurrences.number );
       return;
     }
@@ -111,7 +119,8 @@ void PatternTree::addExtensionLegs ( Tuple &tuple, LegOccurrences &legoccurrence
     // this is the first possible extension, as we force this label to be the lowest!
     addLeg ( fm::graphstate->lastNode (), tuple.depth + 1, pathlowestlabel, fm::candidatelegsoccurrences[pathlowestlabel] );
 
-  for ( int i = 0; (unsigned) i < fm::candidatelegsoccurrences.size (); i++ ) {
+  for ( unsigned int k = 0; k < fm::candidatelegstouched.size (); k++ ) {
+    EdgeLabel i = fm::candidatelegstouched[k];
     if ( fm::candidatelegsoccurrences[i].frequency >= fm::minfreq && i != pathlowestlabel )
       addLeg ( fm::graphstate->lastNode (), tuple.depth + 1, i, fm::candidatelegsoccurrences[i] );
   }
@@ -767,7 +776,7 @@ PatternTree::PatternTree ( PatternTree &parenttree, unsigned int legindex ) {
     
   if ( nextprefixindex == nextpathstart && symmetric == 1 ) {
     secondpathleg = 0; // THE BUG
-    extend ( leg.occurrences, MAXEDGELABEL, (unsigned char) NONODE );
+    extend ( leg.occurrences, MAXEDGELABEL, NOEDGELABEL );
     addCloseExtensions ( closelegs, leg.occurrences.number );
     return;
   }
@@ -827,7 +836,7 @@ PatternTree::PatternTree ( PatternTree &parenttree, unsigned int legindex ) {
   }
 }
 
-GSWalk* PatternTree::expand (pair<float, string> max, const int parent_size) {
+vector<GSWalk*> PatternTree::expand (pair<float, string> max, const int parent_size) {
 
   assert(parent_size>0);
 
@@ -840,12 +849,12 @@ GSWalk* PatternTree::expand (pair<float, string> max, const int parent_size) {
   ++fm::statistics->frequenttreenumbers[fm::statistics->patternsize-1];
   if ( fm::statistics->patternsize == ((1<<(sizeof(NodeId)*8))-1) ) {
     fm::statistics->patternsize--;
-    return NULL;
+    return vector<GSWalk*> ();
   }
    
 
-  // new siblingwalk
-  GSWalk* siblingwalk = new GSWalk();
+  // new siblingwalk (one per endpoint)
+  vector<GSWalk*> siblingwalk = last_walks ();
 
   // needed for topdown and sibling merge
   vector<int> core_ids; 
@@ -853,14 +862,15 @@ GSWalk* PatternTree::expand (pair<float, string> max, const int parent_size) {
 
   for ( int i=legs.size()-1; i>=0; i-- ) {
 
+    if (mining_interrupted ()) break;
 
     // new current pattern
-    GSWalk* gsw = new GSWalk();
-    GSWalk* topdown = NULL;
+    vector<GSWalk*> topdown;
+    vector<bool> nsign (fm::endpoints.size(), 1);
+    vector<ChisqConstraint*> pruned;
+    int gsw_size = 0;
 
-    bool nsign=1;
-
-    if (fm::chisq->active) fm::chisq->Calc(legs[i]->occurrences.elements);
+    if (fm::chisq->active) ChisqConstraint::Calc(fm::endpoints, legs[i]->occurrences.elements);
     float cur_chisq=fm::chisq->p;
 
     fm::graphstate->insertNode ( legs[i]->tuple.connectingnode, legs[i]->tuple.label, legs[i]->occurrences.maxdegree );
@@ -875,93 +885,34 @@ GSWalk* PatternTree::expand (pair<float, string> max, const int parent_size) {
     //if (s.find("N-C-C(-O-C-N)(=C-C)")!=string::npos) { fm::die=1; diehard=1; }
     #endif
 
-    if (fm::chisq->active) { 
-        map<Tid, int> weightmap_a; each_it(fm::chisq->fa_set, set<Tid>::iterator) { weightmap_a.insert(make_pair((*it),1)); }
-        map<Tid, int> weightmap_i; each_it(fm::chisq->fi_set, set<Tid>::iterator) { weightmap_i.insert(make_pair((*it),1)); }
-        fm::graphstate->print(gsw, weightmap_a, weightmap_i); // print to graphstate walk
-        gsw->activating=fm::chisq->activating;
-        if (cur_chisq >= fm::chisq->sig) nsign=0;
+    // CLOSED: REFINE FIRST
+    PatternTree* p = NULL;
+    bool closed = true;
+    if ( ( fm::refine_singles || (legs[i]->occurrences.frequency>1) ) && last_significant () ) {
+        p = new PatternTree ( *this, i );
+        closed = p->closed ( legs[i]->occurrences.frequency );
     }
-    const int gsw_size = gsw->nodewalk.size();
 
     // !STOP: MERGE TO SIBLINGWALK
-    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Already nodes marked as available 5.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl;exit(1); }
-    if (nsign || gsw->activating!=siblingwalk->activating) { // empty sw needs no checks
-          if (siblingwalk->hops>0) {
-              if (siblingwalk->hops>1) {
-                    siblingwalk->svd();
-              }
-              cout << siblingwalk ; 
-          }
-          delete siblingwalk;
-          siblingwalk = new GSWalk();
-    }
-    if (!nsign && ((gsw->activating==siblingwalk->activating) || !siblingwalk->edgewalk.size())) {
-        #ifdef DEBUG
-        if (fm::die) cout << "CR gsw" << endl;
-        #endif
-        int res=gsw->conflict_resolution(core_ids, siblingwalk);
-    }
-
-    if (gsw->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr<<"Error! Still nodes marked as available 5.1. "<<gsw->to_nodes_ex.size()<<" "<<siblingwalk->to_nodes_ex.size()<<endl; exit(1); }
+    for (unsigned int t = 0; t < fm::endpoints.size(); t++)
+        if (!fm::endpoints[t]->pruned) nsign[t] = last_pattern (fm::endpoints[t], siblingwalk[t], core_ids, gsw_size, closed, "5");
 
-    
     // RECURSE
-    if ( ( !fm::do_pruning ||  (  fm::chisq->u >= fm::chisq->sig) ) &&
-         (  fm::refine_singles || (legs[i]->occurrences.frequency>1) )
+    if ( (  fm::refine_singles || (legs[i]->occurrences.frequency>1) ) &&
+         last_refine (pruned)
        ) {
-        PatternTree p ( *this, i );
-        if (cur_chisq > max.first) { fm::updated = true; topdown = p.expand (pair<float, string>(cur_chisq,fm::graphstate->to_s(legs[i]->occurrences.frequency)), gsw_size); }
-        else topdown = p.expand (max, gsw_size);
+        if (!p) p = new PatternTree ( *this, i );
+        if (cur_chisq > max.first) { fm::updated = true; topdown = p->expand (pair<float, string>(cur_chisq,fm::graphstate->to_s(legs[i]->occurrences.frequency)), gsw_size); }
+        else topdown = p->expand (max, gsw_size);
+        for (unsigned int t = 0; t < pruned.size(); t++) pruned[t]->pruned = false;
     }
+    delete p;
 
     // merge to siblingwalk
-    if (topdown != NULL) {
-       if (topdown->edgewalk.size()) {
-
-            #ifdef DEBUG
-            if (fm::die) {
-                cout << "TOPDOWN2 BEGIN " << core_ids.size() << endl;
-                cout << topdown ;
-                cout << "--result--" << endl;
-                cout << siblingwalk ;
-            }
-            #endif
-
-            if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Already nodes marked as available 5.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-            // STOP: OUTPUT TOPDOWN
-            if (nsign || siblingwalk->activating!=topdown->activating) { 
-                #ifdef DEBUG
-                if (fm::die) cout << "STOP CRITERIUM at CHI " << cur_chisq << endl;
-                #endif
-                if (topdown->hops>0) { 
-                    if (topdown->hops>1) { 
-                        topdown->svd();
-                    }
-                    cout << topdown;
-                }
-            }
-            // ELSE: MERGE TO SIBLINGWALK
-            else {
-                int res=topdown->conflict_resolution(core_ids, siblingwalk); 
-            }
-            if (topdown->to_nodes_ex.size() || siblingwalk->to_nodes_ex.size()) { cerr << "Error! Still nodes marked as available 5.2. " << topdown->to_nodes_ex.size() << " " << siblingwalk->to_nodes_ex.size() <<  endl; exit(1); }
-
-            #ifdef DEBUG
-            if (fm::die) {
-                cout << "TOPDOWN2 END " << core_ids.size() << endl;
-                cout << topdown ;
-                cout << "--result--" << endl;
-                cout << siblingwalk ;
-            }
-            #endif
-
-       }
-    }
+    for (unsigned int t = 0; t < topdown.size(); t++) last_topdown (topdown[t], siblingwalk[t], nsign[t], core_ids, "5");
     
     fm::graphstate->deleteNode ();
-    delete topdown;
-    delete gsw;
+    for (unsigned int t = 0; t < topdown.size(); t++) delete topdown[t];
     #ifdef DEBUG
     if (diehard==1) { 
        cerr << "DYING HARD!" << endl;
@@ -982,6 +933,12 @@ GSWalk* PatternTree::expand (pair<float, string> max, const int parent_size) {
 
 
 
+bool PatternTree::closed ( Frequency frequency ) {
+  for ( int i = 0; i < (int) legs.size (); i++ )
+    if ( legs[i]->occurrences.frequency == frequency ) return false;
+  return true;
+}
+
 PatternTree::~PatternTree () {
   for ( int i = 0; i < (int) legs.size (); i++ )
     delete legs[i];
@@ -1031,15 +988,28 @@ void PatternTree::checkIfIndeedNormal () {
   }
 }
 
+// tid:weight pairs, separated by blanks
+static string occurrences (const TidWeights& w) {
+    string s;
+    for (TidWeights::const_iterator it=w.begin(); it!=w.end(); it++) {
+        if (it!=w.begin()) s.append(" ");
+        s.append(to_string(it->first)).append(":").append(to_string(it->second));
+    }
+    return s;
+}
+
 ostream& operator<< (ostream& os, GSWalk* gsw) {
-    static int gsw_counter=0;
+    unsigned int& gsw_counter = fm::gsw_counter; // global, restored when resuming from a checkpoint
 
     #ifndef DEBUG
     if (gsw->edgewalk.size()) {
         gsw_counter++;
-        os << "    <graph id=\"" << gsw_counter << "\" edgedefault=\"undirected\">" << endl;
+        os << "    <graph id=\"";
+        if (fm::shards > 1) os << fm::shard_root << "." << fm::shard_leg << "."; // sort key for merging shards
+        os << gsw_counter << "\" edgedefault=\"undirected\">" << endl;
         os << "        <data key=\"act\">" << gsw->activating << "</data>" << endl;
         os << "        <data key=\"hops\">" << gsw->hops << "</data>" << endl;
+        if (fm::endpoints.size() > 1) os << "        <data key=\"target\">" << gsw->target << "</data>" << endl;
     }
 
     for(vector<GSWNode>::iterator it=gsw->nodewalk.begin(); it!=gsw->nodewalk.end(); it++) {
@@ -1067,6 +1037,10 @@ ostream& operator<< (ostream& os, GSWalk* gsw) {
             os << "            <data key=\"lab_e\">" << labels << "</data>" << endl;
             os << "            <data key=\"weight\">" << it2->second.discrete_weight << "</data>" << endl;
             os << "            <data key=\"del\">" << it2->second.deleted << "</data>" << endl;
+            if (fm::edge_occurrences) {
+                os << "            <data key=\"occ_a\">" << occurrences(it2->second.a) << "</data>" << endl;
+                os << "            <data key=\"occ_i\">" << occurrences(it2->second.i) << "</data>" << endl;
+            }
             os << "        </edge>" << endl;
         }
     }
@@ -1109,10 +1083,10 @@ ostream& operator<< (ostream& os, GSWalk* gsw) {
 
             /*
             int count=0;
-            for (map<Tid, int>::iterator it3=it2->second.a.begin(); it3!=it2->second.a.end(); it3++) {
+            for (TidWeights::iterator it3=it2->second.a.begin(); it3!=it2->second.a.end(); it3++) {
                 count = count + it3->second;
             }
-            for (map<Tid, int>::iterator it3=it2->second.i.begin(); it3!=it2->second.i.end(); it3++) {
+            for (TidWeights::iterator it3=it2->second.i.begin(); it3!=it2->second.i.end(); it3++) {
                 count = count + it3->second;
             }
             os << " " << count;
@@ -1137,7 +1111,7 @@ ostream& operator<< (ostream& os, GSWalk* gsw) {
 
 
 ostream& operator<< (ostream& os, GSWEdge* gswe) {
-    typedef map<Tid,int> mmap;
+    typedef TidWeights mmap;
     os << "To: " << gswe->to;
     os << " Labs: <";
     each_it(gswe->labs, set<InputEdgeLabel>::iterator) {
@@ -1154,13 +1128,14 @@ ostream& operator<< (ostream& os, GSWEdge* gswe) {
         os << it->first << "->" << it->second << " ";
     }
     os << "> ";
+    return os;
 }
 
 ostream& operator<< (ostream& os, GSWNode* gswn) {
-    typedef map<Tid,int> mmap;
     os << " Labs: <";
     each_it(gswn->labs, set<InputEdgeLabel>::iterator) {
         os << *it << " ";
     }
     os << "> ";
+    return os;
 }
@@ -66,7 +66,8 @@ class PatternTree {
   public:
     PatternTree ( Path &path, unsigned int legindex );
     ~PatternTree ();
-    GSWalk* expand (pair<float, string> max, const int parent_size);
+    vector<GSWalk*> expand (pair<float, string> max, const int parent_size); // walks per endpoint
+    bool closed ( Frequency frequency ); // no leg (refinement) has this support
     vector<LegPtr> legs; // pointers used to avoid copy-constructor during a resize of the vector
   private:
     void checkIfIndeedNormal ();